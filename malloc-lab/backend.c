@@ -0,0 +1,38 @@
+/*
+ * backend.c - The mm_backend_t of an mm.c-style package
+ *
+ * Linked into the driver, it describes the package the driver was
+ * built with. Built into a shared library with a package and memlib.c
+ * (make <package>.so), it lets mdriver -b load that package; the
+ * library is built with hidden visibility, so mm_backend is all it
+ * exports and its heap is its own.
+ */
+#include "backend.h"
+#include "mm.h"
+#include "memlib.h"
+
+/* Not every package defines these */
+extern size_t mm_usable_size(void *ptr) __attribute__((weak));
+extern const int mm_thread_safe __attribute__((weak));
+
+static const mm_heap_t heap = {
+	mem_set_limit,
+	mem_set_hugepages,
+	mem_init,
+	mem_reset_brk,
+	mem_heap_lo,
+	mem_heap_hi,
+	mem_is_mapped,
+	mem_peak_heapsize,
+};
+
+__attribute__((visibility("default"))) const mm_backend_t mm_backend = {
+	mm_init,
+	mm_malloc,
+	mm_free,
+	mm_realloc,
+	mm_usable_size,
+	mm_print_stats,
+	&mm_thread_safe,
+	&heap,
+};
@@ -0,0 +1,49 @@
+/*
+ * backend.h - The allocator interface the malloc lab driver runs traces on
+ *
+ * The driver calls the package it is linked with through an
+ * mm_backend_t, and with -b it loads more packages from shared
+ * libraries with dlopen and runs the same traces on each. A library
+ * exports one mm_backend_t named mm_backend: backend.c builds it for
+ * an mm.c-style package and its own copy of memlib.c, and
+ * backend_sys.c for a system allocator such as the C library's.
+ */
+#ifndef __BACKEND_H_
+#define __BACKEND_H_
+
+#include <stdio.h>
+#include <stddef.h>
+
+/* The simulated heap (memlib.c) a package allocates from */
+typedef struct
+{
+	void (*set_limit)(size_t bytes);	/* before init: largest heap */
+	void (*set_hugepages)(int on);		/* before init: use huge pages */
+	void (*init)(void);					/* reserve the heap, once */
+	void (*reset_brk)(void);			/* empty it before each run */
+	void *(*heap_lo)(void);				/* first heap byte */
+	void *(*heap_hi)(void);				/* last heap byte */
+	int (*is_mapped)(void *lo, void *hi); /* [lo, hi] in one mem_map region? */
+	size_t (*peak_heapsize)(void);		/* largest footprint since reset_brk */
+} mm_heap_t;
+
+/* A malloc package */
+typedef struct
+{
+	int (*init)(void);						 /* start an empty heap */
+	void *(*malloc)(size_t size);
+	void (*free)(void *ptr);
+	void *(*realloc)(void *ptr, size_t size);
+	size_t (*usable_size)(void *ptr);		 /* NULL if the package has none */
+	void (*print_stats)(FILE *fp);			 /* NULL if the package has none */
+	const int *thread_safe;					 /* nonzero if callable from many
+												threads; NULL if undeclared */
+	const mm_heap_t *heap;					 /* NULL for a system allocator */
+} mm_backend_t;
+
+/* The symbol the driver looks up in a -b library */
+#define MM_BACKEND_SYMBOL "mm_backend"
+
+extern const mm_backend_t mm_backend;
+
+#endif /* __BACKEND_H_ */
@@ -0,0 +1,35 @@
+/*
+ * backend_sys.c - A system allocator as a backend for mdriver -b
+ *
+ * Built on its own (make sysmalloc.so) it wraps the C library's
+ * malloc. Linked with another allocator (make sysmalloc.so
+ * SYSLIB=-ljemalloc) it wraps that one instead: the driver loads
+ * backends with RTLD_DEEPBIND, so the library's own dependencies come
+ * before the C library when its symbols are bound. A system allocator
+ * has no simulated heap, so the driver checks it for correctness and
+ * times it, but can't measure its utilization.
+ */
+#define _GNU_SOURCE
+#include <stdlib.h>
+#include <malloc.h>
+
+#include "backend.h"
+
+/* System allocators lock for themselves */
+static const int sys_thread_safe = 1;
+
+static int sys_init(void)
+{
+	return 0;
+}
+
+__attribute__((visibility("default"))) const mm_backend_t mm_backend = {
+	sys_init,
+	malloc,
+	free,
+	realloc,
+	malloc_usable_size,
+	NULL,
+	&sys_thread_safe,
+	NULL,
+};
@@ -53,20 +53,36 @@
 #define UTIL_WEIGHT .60
 
 /* 
- * Alignment requirement in bytes (either 4 or 8) 
+ * Alignment requirement in bytes (either 4, 8 or 16). The 64-bit
+ * header mode of mm.c (MM_WIDE, make WIDE=1) aligns to 16 bytes.
  */
+#if MM_WIDE
+#define ALIGNMENT 16
+#else
 #define ALIGNMENT 8  
+#endif
 
 /* 
  * Maximum heap size in bytes 
  */
 #define MAX_HEAP (20*(1<<20))  /* 20 MB */
 
+/*
+ * Bytes above the brk that stay resident when the heap shrinks
+ * (mem_set_release_pad), so a heap that shrinks and grows back a little
+ * does not fault the same pages in again: make RELEASE_PAD=<bytes>
+ */
+#ifndef MEM_RELEASE_PAD
+#define MEM_RELEASE_PAD (1<<20)  /* 1 MB */
+#endif
+
 /*****************************************************************************
  * Set exactly one of these USE_xxx constants to "1" to select a timing method
  *****************************************************************************/
 #define USE_FCYC   0   /* cycle counter w/K-best scheme (x86 & Alpha only) */
 #define USE_ITIMER 0   /* interval timer (any Unix box) */
-#define USE_GETTOD 1   /* gettimeofday (any Unix box) */
+#define USE_GETTOD 0   /* gettimeofday (any Unix box) */
+#define USE_TSC    1   /* invariant TSC, median of runs until its 95% CI is
+                          within 1% (x86-64; CLOCK_MONOTONIC_RAW elsewhere) */
 
 #endif /* __CONFIG_H */
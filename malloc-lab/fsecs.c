@@ -1,14 +1,18 @@
 /****************************
  * High-level timing wrappers
  ****************************/
+#define _GNU_SOURCE           /* sched_setaffinity */
 #include <stdio.h>
+#include <sched.h>
 #include "fsecs.h"
 #include "fcyc.h"
 #include "clock.h"
 #include "ftimer.h"
+#include "ftsc.h"
 #include "config.h"
 
 static double Mhz;  /* estimated CPU clock frequency */
+static int pin_cpu = -1; /* CPU to run the timed function on, or -1 */
 
 extern int verbose; /* -v option in mdriver.c */
 
@@ -36,22 +40,69 @@ void init_fsecs(void)
 #elif USE_GETTOD
     if (verbose)
 	printf("Measuring performance with gettimeofday().\n");
+#elif USE_TSC
+    Mhz = ftsc_mhz();
+    if (verbose && Mhz > 0)
+	printf("Measuring performance with the time stamp counter (%.0f MHz).\n", Mhz);
+    else if (verbose)
+	printf("Measuring performance with CLOCK_MONOTONIC_RAW (no invariant TSC).\n");
 #endif
 }
 
+/*
+ * set_fsecs_cpu - run every timed function on this CPU (-1: don't pin)
+ */
+void set_fsecs_cpu(int cpu)
+{
+    pin_cpu = cpu;
+}
+
 /*
  * fsecs - Return the running time of a function f (in seconds)
  */
 double fsecs(fsecs_test_funct f, void *argp) 
 {
+    cpu_set_t old, set;
+    double secs = 0;
+    int pinned = 0;
+
+    /* pin only the calling thread, and only for the measurement */
+    if (pin_cpu >= 0 && sched_getaffinity(0, sizeof(old), &old) == 0) {
+	CPU_ZERO(&set);
+	CPU_SET(pin_cpu, &set);
+	if (sched_setaffinity(0, sizeof(set), &set) == 0)
+	    pinned = 1;
+	else
+	    fprintf(stderr, "fsecs: can't run on CPU %d, not pinning\n", pin_cpu);
+    }
+
 #if USE_FCYC
-    double cycles = fcyc(f, argp);
-    return cycles/(Mhz*1e6);
+    secs = fcyc(f, argp)/(Mhz*1e6);
 #elif USE_ITIMER
-    return ftimer_itimer(f, argp, 10);
+    secs = ftimer_itimer(f, argp, 10);
 #elif USE_GETTOD
-    return ftimer_gettod(f, argp, 10);
+    secs = ftimer_gettod(f, argp, 10);
+#elif USE_TSC
+    secs = ftsc(f, argp);
 #endif 
+
+    if (pinned)
+	sched_setaffinity(0, sizeof(old), &old);
+    return secs;
+}
+
+/*
+ * fsecs_spread - the relative uncertainty of the last fsecs result:
+ *    half the width of its 95% confidence interval over the result.
+ *    0 for timers that take a plain mean.
+ */
+double fsecs_spread(void)
+{
+#if USE_TSC
+    return ftsc_spread();
+#else
+    return 0;
+#endif
 }
 
 
@@ -0,0 +1,225 @@
+/*
+ * ftsc.c - Estimate the time (in seconds) used by a function f with
+ *     the invariant time stamp counter
+ *
+ * The counter ticks at a constant rate whatever the CPU clock does,
+ * and is read in a few cycles, so even a short trace is timed to well
+ * under a microsecond. Its rate is calibrated once against
+ * CLOCK_MONOTONIC_RAW, which is not slewed by NTP.
+ *
+ * A single mean hides how noisy the runs were. ftsc instead makes a
+ * few untimed warm-up runs, then times runs one at a time until the
+ * distribution-free 95% confidence interval of their median is within
+ * epsilon of the median, and returns the median. Outliers (an
+ * interrupt, a page cache flush) move the median much less than the
+ * mean, and the interval tells the caller how far to trust it.
+ */
+#include <stdio.h>
+#include <math.h>
+#include <time.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <cpuid.h>
+#include <x86intrin.h>
+#endif
+
+#include "ftsc.h"
+
+/* Default values */
+#define WARMUP 1             /* untimed runs */
+#define MINRUNS 7            /* fewest timed runs */
+#define MAXRUNS 51           /* most timed runs */
+#define EPSILON 0.01         /* target relative half-width of the interval */
+#define MAXSECS 2.0          /* stop after MINRUNS once this much time is spent */
+#define RUNS_CAP 101         /* size of the sample array */
+#define CALIBRATE_NS 20000000 /* length of one calibration interval */
+
+static int warmup = WARMUP;
+static int minruns = MINRUNS;
+static int maxruns = MAXRUNS;
+static double epsilon = EPSILON;
+
+static double tsc_mhz = -1;  /* -1 until calibrated, 0 if there is no invariant TSC */
+static double samples[RUNS_CAP]; /* run times of the current call, sorted */
+static int nsamples = 0;
+static double last_spread = 0;
+
+/* function prototypes */
+static unsigned long long now_ticks(void);
+static unsigned long long read_tsc(void);
+static unsigned long long clock_ns(void);
+static int invariant_tsc(void);
+static void add_sample(double secs);
+static double interval(double *lo, double *hi);
+
+/*
+ * ftsc - Return the median running time of f(argp) in seconds
+ */
+double ftsc(ftsc_test_funct f, void *argp)
+{
+    double mhz = ftsc_mhz();
+    double ticks_per_sec = mhz > 0 ? mhz * 1e6 : 1e9;
+    double spent = 0, median, lo, hi;
+    unsigned long long start;
+    int i;
+
+    for (i = 0; i < warmup; i++)
+	f(argp);
+
+    nsamples = 0;
+    do {
+	start = now_ticks();
+	f(argp);
+	add_sample((now_ticks() - start) / ticks_per_sec);
+	spent += samples[nsamples - 1];
+	median = interval(&lo, &hi);
+	last_spread = median > 0 ? (hi - lo) / 2 / median : 0;
+    } while (nsamples < maxruns &&
+	     (nsamples < minruns || (last_spread > epsilon && spent < MAXSECS)));
+    return median;
+}
+
+double ftsc_spread(void)
+{
+    return last_spread;
+}
+
+int ftsc_runs(void)
+{
+    return nsamples;
+}
+
+/*
+ * ftsc_mhz - Calibrate the counter: the median of three intervals of
+ *     CALIBRATE_NS, each timed by both the counter and the raw clock.
+ *     The intervals are spun, not slept: a virtual CPU that halts may
+ *     see its counter advance at a different rate while it sleeps.
+ */
+double ftsc_mhz(void)
+{
+    unsigned long long t0, t1, c0, c1;
+    double rates[3], tmp;
+    int i, j;
+
+    if (tsc_mhz >= 0)
+	return tsc_mhz;
+    if (!invariant_tsc()) {
+	tsc_mhz = 0;
+	return tsc_mhz;
+    }
+    for (i = 0; i < 3; i++) {
+	c0 = clock_ns();
+	t0 = read_tsc();
+	while ((c1 = clock_ns()) - c0 < CALIBRATE_NS)
+	    ;
+	t1 = read_tsc();
+	rates[i] = (double)(t1 - t0) * 1e3 / (double)(c1 - c0);
+	for (j = i; j > 0 && rates[j - 1] > rates[j]; j--) {
+	    tmp = rates[j];
+	    rates[j] = rates[j - 1];
+	    rates[j - 1] = tmp;
+	}
+    }
+    tsc_mhz = rates[1];
+    return tsc_mhz;
+}
+
+void set_ftsc_warmup(int n)
+{
+    warmup = n;
+}
+
+void set_ftsc_runs(int min, int max)
+{
+    maxruns = max < RUNS_CAP ? max : RUNS_CAP;
+    minruns = min < maxruns ? min : maxruns;
+}
+
+void set_ftsc_epsilon(double eps)
+{
+    epsilon = eps;
+}
+
+/*
+ * now_ticks - Read the counter, or the raw clock in ns without one
+ */
+static unsigned long long now_ticks(void)
+{
+    return tsc_mhz > 0 ? read_tsc() : clock_ns();
+}
+
+/*
+ * read_tsc - Read the counter. rdtscp waits for the instructions
+ *     before it to finish, so the timed function can't leak past it.
+ */
+static unsigned long long read_tsc(void)
+{
+#if defined(__x86_64__) || defined(__i386__)
+    unsigned int aux;
+
+    return __rdtscp(&aux);
+#else
+    return 0;
+#endif
+}
+
+static unsigned long long clock_ns(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC_RAW, &ts);
+    return (unsigned long long)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+/*
+ * invariant_tsc - Does the CPU have rdtscp and a counter that ticks at
+ *     a constant rate in every P- and C-state? (CPUID 0x80000001 EDX
+ *     bit 27 and 0x80000007 EDX bit 8)
+ */
+static int invariant_tsc(void)
+{
+#if defined(__x86_64__) || defined(__i386__)
+    unsigned int eax, ebx, ecx, edx;
+
+    if (!__get_cpuid(0x80000001, &eax, &ebx, &ecx, &edx) || !(edx & (1 << 27)))
+	return 0;
+    if (!__get_cpuid(0x80000007, &eax, &ebx, &ecx, &edx))
+	return 0;
+    return (edx & (1 << 8)) != 0;
+#else
+    return 0;
+#endif
+}
+
+/*
+ * add_sample - Insert a run time into the sorted sample array
+ */
+static void add_sample(double secs)
+{
+    int i;
+
+    for (i = nsamples; i > 0 && samples[i - 1] > secs; i--)
+	samples[i] = samples[i - 1];
+    samples[i] = secs;
+    nsamples++;
+}
+
+/*
+ * interval - Return the median of the samples and store the bounds of
+ *     its 95% confidence interval: the order statistics n/2 -+ 0.98
+ *     sqrt(n), which need no assumption about the distribution
+ */
+static double interval(double *lo, double *hi)
+{
+    int n = nsamples;
+    double half = 0.98 * sqrt(n);
+    int j = (int)floor(n / 2.0 - half);
+    int k = (int)ceil(1 + n / 2.0 + half);
+
+    if (j < 1)
+	j = 1;
+    if (k > n)
+	k = n;
+    *lo = samples[j - 1];
+    *hi = samples[k - 1];
+    return (n % 2) ? samples[n / 2] : (samples[n / 2 - 1] + samples[n / 2]) / 2;
+}
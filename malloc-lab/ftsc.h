@@ -0,0 +1,56 @@
+/*
+ * ftsc.h - prototypes for the routines in ftsc.c that estimate the
+ *     time in seconds used by a test function f with the invariant
+ *     time stamp counter
+ */
+
+/* The test function takes a generic pointer as input */
+typedef void (*ftsc_test_funct)(void *);
+
+/*
+ * ftsc - Return the median running time of f(argp) in seconds, over
+ *     enough runs that the 95% confidence interval of the median is
+ *     within epsilon of it (or maxruns runs, whichever comes first)
+ */
+double ftsc(ftsc_test_funct f, void *argp);
+
+/*
+ * ftsc_spread - Half the width of the 95% confidence interval of the
+ *     median found by the last call to ftsc, relative to the median
+ */
+double ftsc_spread(void);
+
+/*
+ * ftsc_runs - Number of timed runs made by the last call to ftsc
+ */
+int ftsc_runs(void);
+
+/*
+ * ftsc_mhz - Calibrate the counter against CLOCK_MONOTONIC_RAW (once)
+ *     and return its frequency in MHz. Returns 0 if the machine has no
+ *     invariant TSC, in which case ftsc times with the clock itself.
+ */
+double ftsc_mhz(void);
+
+/*********************************************************
+ * Set the various parameters used by measurement routines
+ *********************************************************/
+
+/*
+ * set_ftsc_warmup - Untimed runs made before the timed ones
+ *     Default = 1
+ */
+void set_ftsc_warmup(int n);
+
+/*
+ * set_ftsc_runs - Fewest and most timed runs
+ *     Default = 7, 51
+ */
+void set_ftsc_runs(int minruns, int maxruns);
+
+/*
+ * set_ftsc_epsilon - Relative half-width of the confidence interval
+ *     at which sampling stops
+ *     Default = 0.01
+ */
+void set_ftsc_epsilon(double epsilon);
@@ -0,0 +1,751 @@
+/*
+ * gentrace.c - Generate a synthetic malloc lab trace
+ *
+ * usage: gentrace [-hrv] [-n <allocs>] [-s <sizes>] [-l <lifetimes>]
+ *                 [-c <chains>] [-p <messages>] [-k <pct>] [-M <bytes>]
+ *                 [-S <seed>] <trace>
+ *
+ * Where the gen_*.pl scripts each write one fixed pattern, gentrace
+ * draws every block's size and lifetime from a distribution:
+ *
+ *   sizes (-s)       uniform:<lo>:<hi>
+ *                    lognormal:<median>:<sigma>
+ *                    zipf:<s>:<n>[:<step>]   sizes step..n*step, rank k
+ *                                            drawn with weight 1/k^s
+ *                    hist:<file>             lines of "<size> <weight>"
+ *                                            or "<lo> <hi> <weight>"
+ *   lifetimes (-l)   exp:<mean>      exponential, in allocations
+ *                    phase:<len>     blocks die when their phase of
+ *                                    len allocations ends
+ *                    lifo:<mean>     exponential, but blocks are freed
+ *                                    in the reverse order of allocation
+ *
+ * On top of those, a share of the blocks can be growing buffers (-c
+ * <pct>:<growth>:<count>: count reallocs spread over the block's life,
+ * each growth times the last size), messages passed from a producer to
+ * a consumer (-p <pct>:<depth>: freed in allocation order, depth
+ * allocations after they were made), or long-lived (-k <pct>: freed at
+ * the end). Every block is freed, so the trace is balanced.
+ *
+ * Time is counted in allocations, and the pending frees and reallocs
+ * wait in a priority queue, so memory use grows with the number of
+ * live blocks, not with the length of the trace. The generator runs
+ * twice with the same seed: once to size the header, once to write
+ * the trace, so the output can be a pipe. The output is a binary
+ * trace, or ASCII with -r; either format holds up to INT_MAX requests.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <inttypes.h>
+#include <limits.h>
+#include <math.h>
+#include <unistd.h>
+
+#include "trace.h"
+
+/* Defaults: the pattern of gen_random.pl, with exponential lifetimes */
+#define ALLOCS 2400			/* blocks allocated */
+#define SIZES "uniform:1:32768"
+#define LIFETIMES "exp:1000"
+#define GROWTH 2.0			/* -c: size factor of each realloc */
+#define CHAIN_LEN 4			/* -c: reallocs per growing buffer */
+#define DEPTH 100			/* -p: queue depth in allocations */
+#define MAX_SIZE (64 << 20) /* largest request (-M) */
+#define SEED 1
+#define MAX_ZIPF (1 << 24)	/* most ranks in a zipf distribution */
+
+#define NEVER UINT64_MAX /* death time of a long-lived block */
+
+/* Size distributions */
+enum
+{
+	S_UNIFORM,
+	S_LOGNORMAL,
+	S_ZIPF,
+	S_HIST
+};
+
+/* Lifetime distributions */
+enum
+{
+	L_EXP,
+	L_PHASE,
+	L_LIFO
+};
+
+/* What happens to a block when its event comes up */
+enum
+{
+	EV_REALLOC, /* before any free at the same time */
+	EV_FREE
+};
+
+/* A pending realloc or free, keyed by (time, kind, tie) */
+typedef struct
+{
+	uint64_t time; /* the allocation it comes just before */
+	uint64_t tie;  /* order among events of one time and kind */
+	uint32_t id;
+	uint8_t kind;	   /* EV_REALLOC or EV_FREE */
+	uint8_t left;	   /* reallocs still to come after this one */
+	uint8_t on_stack;  /* on the LIFO stack? */
+	uint64_t size;	   /* the block's size */
+	uint64_t death;	   /* time of the block's free */
+} event_t;
+
+/* One bar of an empirical size histogram */
+typedef struct
+{
+	size_t lo, hi;
+	double cum; /* weight of this bar and all before it */
+} bar_t;
+
+/* What a run of the generator produced */
+typedef struct
+{
+	uint64_t ops, allocs, reallocs, frees;
+	uint64_t live_bytes, peak_bytes;
+	uint64_t live_blocks, peak_blocks;
+	uint64_t peak_bytes_blocks; /* blocks live when peak_bytes was reached */
+	uint64_t alloc_bytes;
+} gen_stats_t;
+
+/* Parameters */
+static uint64_t num_allocs = ALLOCS;
+static int size_dist, life_dist;
+static double size_a, size_b, size_c; /* parameters of the size distribution */
+static double life_param;
+static double chain_pct, growth = GROWTH;
+static int chain_len = CHAIN_LEN;
+static double msg_pct;
+static uint64_t depth = DEPTH;
+static double keep_pct;
+static size_t max_size = MAX_SIZE;
+static uint64_t seed = SEED;
+
+/* Sampling tables */
+static double *zipf_cdf;
+static bar_t *bars;
+static int nbars;
+
+/* State of one run */
+static uint64_t rng;
+static event_t *queue;
+static size_t queue_len, queue_max;
+static uint64_t *stack; /* death times of the live LIFO blocks */
+static size_t stack_len, stack_max;
+
+static void generate(trace_writer_t *w, gen_stats_t *st);
+static void fire(trace_writer_t *w, gen_stats_t *st, event_t *e);
+static void put(trace_writer_t *w, gen_stats_t *st, int type, uint32_t id,
+				size_t size, int64_t bytes);
+static uint64_t lifetime(uint64_t now);
+static size_t draw_size(void);
+static double uniform(void);
+static uint64_t mix(uint64_t x);
+static int before(const event_t *a, const event_t *b);
+static void push(const event_t *e);
+static void pop(event_t *e);
+static void parse_sizes(const char *spec);
+static void parse_lifetimes(const char *spec);
+static void read_hist(const char *path);
+static uint64_t parse_count(const char *s, double unit, const char *what);
+static void usage(void);
+static void fail(const char *what, const char *msg);
+
+int main(int argc, char **argv)
+{
+	int c, to_rep = 0, verbose = 0;
+	const char *sizes = SIZES, *lifetimes = LIFETIMES;
+	trace_writer_t w;
+	trace_hdr_t hdr;
+	gen_stats_t st;
+	FILE *fp;
+
+	while ((c = getopt(argc, argv, "hrvn:s:l:c:p:k:M:S:")) != EOF)
+	{
+		switch (c)
+		{
+		case 'n':
+			num_allocs = parse_count(optarg, 1000, "-n");
+			break;
+		case 's':
+			sizes = optarg;
+			break;
+		case 'l':
+			lifetimes = optarg;
+			break;
+		case 'c':
+			if (sscanf(optarg, "%lf:%lf:%d", &chain_pct, &growth, &chain_len) < 1 ||
+				chain_pct < 0 || chain_pct > 100 || growth <= 0 ||
+				chain_len < 1 || chain_len > 255)
+				fail("-c", "expects <pct>[:<growth>[:<count>]], count 1..255");
+			break;
+		case 'p':
+			if (sscanf(optarg, "%lf:%" SCNu64, &msg_pct, &depth) < 1 ||
+				msg_pct < 0 || msg_pct > 100 || depth < 1)
+				fail("-p", "expects <pct>[:<depth>]");
+			break;
+		case 'k':
+			keep_pct = atof(optarg);
+			if (keep_pct < 0 || keep_pct > 100)
+				fail("-k", "expects a percentage");
+			break;
+		case 'M':
+			max_size = parse_count(optarg, 1024, "-M");
+			break;
+		case 'S':
+			seed = strtoull(optarg, NULL, 0);
+			break;
+		case 'r':
+			to_rep = 1;
+			break;
+		case 'v':
+			verbose = 1;
+			break;
+		case 'h':
+			usage();
+			exit(0);
+		default:
+			usage();
+			exit(1);
+		}
+	}
+	if (argc - optind != 1)
+	{
+		usage();
+		exit(1);
+	}
+	if (chain_pct + msg_pct + keep_pct > 100)
+		fail("-c, -p and -k", "add up to more than 100%");
+	if (num_allocs > INT_MAX)
+		fail("-n", "a trace holds at most INT_MAX blocks");
+	parse_sizes(sizes);
+	parse_lifetimes(lifetimes);
+
+	/* Size the trace */
+	trace_writer_init(&w, NULL, !to_rep);
+	generate(&w, &st);
+	if (st.ops > INT_MAX)
+		fail(argv[optind], "more than INT_MAX requests; lower -n");
+
+	/* Then write it */
+	if (strcmp(argv[optind], "-") == 0)
+		fp = stdout;
+	else if ((fp = fopen(argv[optind], "w")) == NULL)
+	{
+		perror(argv[optind]);
+		exit(1);
+	}
+	memset(&hdr, 0, sizeof(hdr));
+	hdr.sugg_heapsize = st.peak_bytes < INT_MAX ? st.peak_bytes : INT_MAX;
+	hdr.num_ids = st.allocs;
+	hdr.num_ops = st.ops;
+	hdr.weight = 1;
+	hdr.recs_len = w.recs_len;
+	trace_writer_init(&w, fp, !to_rep);
+	if (trace_put_header(&w, &hdr) < 0)
+		fail(argv[optind], "write failed");
+	generate(&w, &st);
+	if (ferror(fp) || fclose(fp) != 0)
+		fail(argv[optind], "write failed");
+
+	if (verbose)
+	{
+		fprintf(stderr, "%" PRIu64 " requests: %" PRIu64 " mallocs, %" PRIu64
+				" reallocs, %" PRIu64 " frees\n",
+				st.ops, st.allocs, st.reallocs, st.frees);
+		fprintf(stderr, "%.1f bytes per malloc; peak %" PRIu64 " bytes in %" PRIu64
+				" blocks; at most %" PRIu64 " blocks live\n",
+				st.allocs ? (double)st.alloc_bytes / st.allocs : 0.0,
+				st.peak_bytes, st.peak_bytes_blocks, st.peak_blocks);
+	}
+	exit(0);
+}
+
+/*
+ * generate - Run the generator from the seed, putting every request
+ */
+static void generate(trace_writer_t *w, gen_stats_t *st)
+{
+	uint64_t now, death;
+	double u;
+	event_t e;
+	size_t size;
+
+	memset(st, 0, sizeof(*st));
+	rng = seed;
+	queue_len = stack_len = 0;
+
+	for (now = 0; now < num_allocs; now++)
+	{
+		/* The frees and reallocs due before this allocation */
+		while (queue_len > 0 && queue[0].time <= now)
+		{
+			pop(&e);
+			fire(w, st, &e);
+		}
+
+		size = draw_size();
+		put(w, st, ALLOC, now, size, size);
+
+		/* Decide what kind of block it is, and when it dies */
+		memset(&e, 0, sizeof(e));
+		e.id = now;
+		e.size = size;
+		u = uniform() * 100;
+		if (u < msg_pct)
+		{
+			death = now + depth; /* equal lifetimes: a FIFO queue */
+			e.tie = now;
+		}
+		else if (u < msg_pct + keep_pct)
+		{
+			death = NEVER;
+			e.tie = now;
+		}
+		else
+		{
+			death = lifetime(now);
+			e.tie = (life_dist == L_PHASE) ? mix(now ^ seed) : now;
+		}
+
+		/* LIFO blocks die no later than the block below them */
+		if (life_dist == L_LIFO && !(u < msg_pct))
+		{
+			if (stack_len > 0 && death > stack[stack_len - 1])
+				death = stack[stack_len - 1];
+			if (stack_len == stack_max)
+			{
+				stack_max = stack_max ? 2 * stack_max : 1024;
+				if ((stack = realloc(stack, stack_max * sizeof(uint64_t))) == NULL)
+					fail("stack", "realloc failed");
+			}
+			stack[stack_len++] = death;
+			e.tie = UINT64_MAX - now; /* the newest of a time goes first */
+			e.on_stack = 1;
+		}
+		e.death = death;
+
+		/* A growing buffer is realloced chain_len times as it lives */
+		if (u >= msg_pct + keep_pct && u < msg_pct + keep_pct + chain_pct)
+		{
+			e.kind = EV_REALLOC;
+			e.left = chain_len - 1;
+			e.time = now + 1 + (death == NEVER ? (uint64_t)life_param : death - now - 1) /
+								   (chain_len + 1);
+			if (e.time < death)
+			{
+				push(&e);
+				continue;
+			}
+		}
+		e.kind = EV_FREE;
+		e.time = death;
+		push(&e);
+	}
+
+	/* Free whatever is still live, in order */
+	while (queue_len > 0)
+	{
+		pop(&e);
+		fire(w, st, &e);
+	}
+}
+
+/*
+ * fire - Put the request of an event that came up, and queue the
+ *     next event of its block
+ */
+static void fire(trace_writer_t *w, gen_stats_t *st, event_t *e)
+{
+	uint64_t gap, span, size;
+
+	if (e->kind == EV_FREE)
+	{
+		put(w, st, FREE, e->id, 0, -(int64_t)e->size);
+		if (e->on_stack)
+			stack_len--; /* it was the top: frees of a time go newest first */
+		return;
+	}
+
+	size = (uint64_t)ceil(e->size * growth);
+	if (size > max_size)
+		size = max_size;
+	if (size == 0)
+		size = 1;
+	put(w, st, REALLOC, e->id, size, (int64_t)size - (int64_t)e->size);
+	e->size = size;
+
+	/* Queue the next realloc, or the free */
+	span = (e->death == NEVER) ? (uint64_t)life_param : e->death - e->time;
+	gap = span / (e->left + 1);
+	if (e->left > 0 && (e->death == NEVER || e->time + gap < e->death))
+	{
+		e->left--;
+		e->time += gap;
+	}
+	else
+	{
+		e->kind = EV_FREE;
+		e->time = e->death;
+	}
+	push(e);
+}
+
+/*
+ * put - Put one request, which changes the live bytes by bytes, and
+ *     keep count
+ */
+static void put(trace_writer_t *w, gen_stats_t *st, int type, uint32_t id,
+				size_t size, int64_t bytes)
+{
+	traceop_t op;
+
+	op.type = type;
+	op.index = id;
+	op.size = size;
+	trace_put(w, &op);
+	st->ops++;
+	st->live_bytes += bytes;
+	switch (type)
+	{
+	case ALLOC:
+		st->allocs++;
+		st->alloc_bytes += size;
+		st->live_blocks++;
+		break;
+	case REALLOC:
+		st->reallocs++;
+		break;
+	case FREE:
+		st->frees++;
+		st->live_blocks--;
+		break;
+	}
+	if (st->live_bytes > st->peak_bytes)
+	{
+		st->peak_bytes = st->live_bytes;
+		st->peak_bytes_blocks = st->live_blocks;
+	}
+	if (st->live_blocks > st->peak_blocks)
+		st->peak_blocks = st->live_blocks;
+}
+
+/*
+ * lifetime - When a block allocated now is freed: just before which
+ *     later allocation
+ */
+static uint64_t lifetime(uint64_t now)
+{
+	uint64_t len;
+
+	switch (life_dist)
+	{
+	case L_PHASE:
+		len = (uint64_t)life_param;
+		return (now / len + 1) * len;
+	default: /* L_EXP, L_LIFO */
+		return now + 1 + (uint64_t)(-life_param * log(1 - uniform()));
+	}
+}
+
+/*
+ * draw_size - Draw a request size from the size distribution
+ */
+static size_t draw_size(void)
+{
+	double u, v, x;
+	size_t lo, hi, mid, size;
+
+	switch (size_dist)
+	{
+	case S_UNIFORM:
+		x = size_a + floor(uniform() * (size_b - size_a + 1));
+		break;
+	case S_LOGNORMAL:
+		/* Box-Muller */
+		u = uniform();
+		v = uniform();
+		x = size_a * exp(size_b * sqrt(-2 * log(1 - u)) * cos(2 * M_PI * v));
+		break;
+	case S_ZIPF:
+		u = uniform() * zipf_cdf[(size_t)size_b - 1];
+		for (lo = 0, hi = (size_t)size_b - 1; lo < hi;)
+		{
+			mid = (lo + hi) / 2;
+			if (zipf_cdf[mid] <= u)
+				lo = mid + 1;
+			else
+				hi = mid;
+		}
+		x = (lo + 1) * size_c;
+		break;
+	default: /* S_HIST */
+		u = uniform() * bars[nbars - 1].cum;
+		for (lo = 0, hi = nbars - 1; lo < hi;)
+		{
+			mid = (lo + hi) / 2;
+			if (bars[mid].cum <= u)
+				lo = mid + 1;
+			else
+				hi = mid;
+		}
+		x = bars[lo].lo + floor(uniform() * (bars[lo].hi - bars[lo].lo + 1));
+		break;
+	}
+	if (x < 1)
+		return 1;
+	size = (x >= (double)max_size) ? max_size : (size_t)x;
+	return size;
+}
+
+/*
+ * uniform - A random number in [0, 1): splitmix64, 53 bits
+ */
+static double uniform(void)
+{
+	return (mix(rng += 0x9E3779B97F4A7C15ULL) >> 11) * 0x1.0p-53;
+}
+
+/*
+ * mix - The splitmix64 output function
+ */
+static uint64_t mix(uint64_t x)
+{
+	x = (x ^ (x >> 30)) * 0xBF58476D1CE4E5B9ULL;
+	x = (x ^ (x >> 27)) * 0x94D049BB133111EBULL;
+	return x ^ (x >> 31);
+}
+
+/*
+ * before - Does event a come before event b?
+ */
+static int before(const event_t *a, const event_t *b)
+{
+	if (a->time != b->time)
+		return a->time < b->time;
+	if (a->kind != b->kind)
+		return a->kind < b->kind;
+	return a->tie < b->tie;
+}
+
+/*
+ * push - Add an event to the queue (a binary min-heap)
+ */
+static void push(const event_t *e)
+{
+	size_t i, parent;
+
+	if (queue_len == queue_max)
+	{
+		queue_max = queue_max ? 2 * queue_max : 1024;
+		if ((queue = realloc(queue, queue_max * sizeof(event_t))) == NULL)
+			fail("queue", "realloc failed");
+	}
+	for (i = queue_len++; i > 0; i = parent)
+	{
+		parent = (i - 1) / 2;
+		if (!before(e, &queue[parent]))
+			break;
+		queue[i] = queue[parent];
+	}
+	queue[i] = *e;
+}
+
+/*
+ * pop - Take the first event off the queue
+ */
+static void pop(event_t *e)
+{
+	event_t last;
+	size_t i, child;
+
+	*e = queue[0];
+	last = queue[--queue_len];
+	for (i = 0; (child = 2 * i + 1) < queue_len; i = child)
+	{
+		if (child + 1 < queue_len && before(&queue[child + 1], &queue[child]))
+			child++;
+		if (!before(&queue[child], &last))
+			break;
+		queue[i] = queue[child];
+	}
+	queue[i] = last;
+}
+
+/*
+ * parse_sizes - Set up the -s size distribution
+ */
+static void parse_sizes(const char *spec)
+{
+	double sum = 0;
+	size_t k;
+
+	size_c = 16;
+	if (sscanf(spec, "uniform:%lf:%lf", &size_a, &size_b) == 2)
+	{
+		size_dist = S_UNIFORM;
+		if (size_a < 1 || size_b < size_a)
+			fail(spec, "expects 1 <= lo <= hi");
+	}
+	else if (sscanf(spec, "lognormal:%lf:%lf", &size_a, &size_b) == 2)
+	{
+		size_dist = S_LOGNORMAL;
+		if (size_a < 1 || size_b < 0)
+			fail(spec, "expects a median >= 1 and sigma >= 0");
+	}
+	else if (sscanf(spec, "zipf:%lf:%lf:%lf", &size_a, &size_b, &size_c) >= 2)
+	{
+		size_dist = S_ZIPF;
+		if (size_a < 0 || size_b < 1 || size_b > MAX_ZIPF || size_c < 1)
+			fail(spec, "expects s >= 0, 1 <= n <= 2^24 and step >= 1");
+		if ((zipf_cdf = malloc((size_t)size_b * sizeof(double))) == NULL)
+			fail("zipf table", "malloc failed");
+		for (k = 0; k < (size_t)size_b; k++)
+		{
+			sum += pow(k + 1, -size_a);
+			zipf_cdf[k] = sum;
+		}
+	}
+	else if (strncmp(spec, "hist:", 5) == 0)
+	{
+		size_dist = S_HIST;
+		read_hist(spec + 5);
+	}
+	else
+		fail(spec, "unknown size distribution");
+}
+
+/*
+ * parse_lifetimes - Set up the -l lifetime distribution
+ */
+static void parse_lifetimes(const char *spec)
+{
+	if (sscanf(spec, "exp:%lf", &life_param) == 1)
+		life_dist = L_EXP;
+	else if (sscanf(spec, "phase:%lf", &life_param) == 1)
+		life_dist = L_PHASE;
+	else if (sscanf(spec, "lifo:%lf", &life_param) == 1)
+		life_dist = L_LIFO;
+	else
+		fail(spec, "unknown lifetime distribution");
+	if (life_param < 1)
+		fail(spec, "expects a lifetime of at least 1");
+}
+
+/*
+ * read_hist - Read an empirical size histogram. Each line holds a size
+ *     and its weight, or a range of sizes and the weight of the whole
+ *     range, separated by blanks or commas; other lines (a CSV header,
+ *     comments) are skipped.
+ */
+static void read_hist(const char *path)
+{
+	char line[1024], *p, *end;
+	double v[3], cum = 0;
+	int n, max = 0;
+	FILE *fp;
+
+	if ((fp = fopen(path, "r")) == NULL)
+		fail(path, "can't open");
+	while (fgets(line, sizeof(line), fp) != NULL)
+	{
+		for (n = 0, p = line; n < 3; n++, p = end)
+		{
+			while (*p == ' ' || *p == '\t' || *p == ',')
+				p++;
+			v[n] = strtod(p, &end);
+			if (end == p)
+				break;
+		}
+		if (n < 2)
+			continue;
+		if (n == 2)
+		{
+			v[2] = v[1];
+			v[1] = v[0];
+		}
+		if (v[0] < 1 || v[1] < v[0] || v[2] < 0)
+			fail(path, "bad histogram line");
+		if (v[2] == 0)
+			continue;
+		if (nbars == max)
+		{
+			max = max ? 2 * max : 64;
+			if ((bars = realloc(bars, max * sizeof(bar_t))) == NULL)
+				fail("histogram", "realloc failed");
+		}
+		cum += v[2];
+		bars[nbars].lo = v[0];
+		bars[nbars].hi = v[1];
+		bars[nbars].cum = cum;
+		nbars++;
+	}
+	fclose(fp);
+	if (nbars == 0)
+		fail(path, "no sizes in the histogram");
+}
+
+/*
+ * parse_count - Parse a count or size, with an optional K, M or G
+ *     suffix in powers of unit (1000 or 1024)
+ */
+static uint64_t parse_count(const char *s, double unit, const char *what)
+{
+	char *end;
+	double v = strtod(s, &end);
+
+	switch (*end)
+	{
+	case 'k':
+	case 'K':
+		v *= unit;
+		break;
+	case 'm':
+	case 'M':
+		v *= unit * unit;
+		break;
+	case 'g':
+	case 'G':
+		v *= unit * unit * unit;
+		break;
+	case '\0':
+		break;
+	default:
+		fail(what, "expects a number such as 2400, 500K or 1G");
+	}
+	if (v < 1)
+		fail(what, "expects a positive number");
+	return (uint64_t)v;
+}
+
+static void usage(void)
+{
+	fprintf(stderr, "Usage: gentrace [-hrv] [-n <allocs>] [-s <sizes>] [-l <lifetimes>]\n");
+	fprintf(stderr, "                [-c <chains>] [-p <messages>] [-k <pct>] [-M <bytes>]\n");
+	fprintf(stderr, "                [-S <seed>] <trace>\n");
+	fprintf(stderr, "Options\n");
+	fprintf(stderr, "\t-c <pct>[:<growth>[:<n>]]  Growing buffers, realloced n times (%.0f, %d).\n",
+			GROWTH, CHAIN_LEN);
+	fprintf(stderr, "\t-h         Print this message.\n");
+	fprintf(stderr, "\t-k <pct>   Long-lived blocks, freed at the end.\n");
+	fprintf(stderr, "\t-l <dist>  Lifetimes: exp:<mean>, phase:<len> or lifo:<mean> (%s).\n",
+			LIFETIMES);
+	fprintf(stderr, "\t-M <bytes> Largest request (default %dM).\n", MAX_SIZE >> 20);
+	fprintf(stderr, "\t-n <n>     Blocks to allocate, e.g. 500K or 1G (default %d).\n", ALLOCS);
+	fprintf(stderr, "\t-p <pct>[:<depth>]  Producer/consumer messages (depth %d).\n", DEPTH);
+	fprintf(stderr, "\t-r         Write an ASCII .rep trace (default: binary).\n");
+	fprintf(stderr, "\t-s <dist>  Sizes: uniform:<lo>:<hi>, lognormal:<median>:<sigma>,\n");
+	fprintf(stderr, "\t           zipf:<s>:<n>[:<step>] or hist:<file> (%s).\n", SIZES);
+	fprintf(stderr, "\t-S <seed>  Seed of the random numbers (default %d).\n", SEED);
+	fprintf(stderr, "\t-v         Print a summary of the trace.\n");
+}
+
+static void fail(const char *what, const char *msg)
+{
+	fprintf(stderr, "gentrace: %s: %s\n", what, msg);
+	exit(1);
+}
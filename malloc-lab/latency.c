@@ -0,0 +1,98 @@
+/*
+ * latency.c - Per-request latency histograms for the malloc lab driver
+ *
+ * See latency.h. Recording is inline; this file holds the parts that
+ * run once per trace, or only for a request slower than the current
+ * LAT_TOP slowest.
+ */
+#include <string.h>
+
+#include "latency.h"
+
+/*
+ * lat_reset - Empty the histograms and the list of slowest requests
+ */
+void lat_reset(latency_t *lat)
+{
+	memset(lat, 0, sizeof(*lat));
+}
+
+/*
+ * lat_add_top - Insert a request into the slowest-first list, dropping
+ *     the fastest entry if the list is full. Called by lat_record only
+ *     when the request belongs in the list.
+ */
+void lat_add_top(latency_t *lat, int type, int opnum, size_t size, uint64_t ticks)
+{
+	int i = (lat->ntop < LAT_TOP) ? lat->ntop++ : LAT_TOP - 1;
+
+	for (; i > 0 && lat->top[i - 1].ticks < ticks; i--)
+		lat->top[i] = lat->top[i - 1];
+	lat->top[i].ticks = ticks;
+	lat->top[i].opnum = opnum;
+	lat->top[i].type = type;
+	lat->top[i].size = size;
+}
+
+/*
+ * lat_percentile - The latency that pct percent of the requests did
+ *     not exceed: the top of the bucket holding that rank, but never
+ *     more than the slowest request. Returns 0 for an empty histogram.
+ */
+uint64_t lat_percentile(const lathist_t *h, double pct)
+{
+	uint64_t rank, seen = 0, hi;
+	int i, shift;
+
+	if (h->count == 0)
+		return 0;
+	rank = (uint64_t)(pct / 100.0 * h->count + 0.5);
+	if (rank < 1)
+		rank = 1;
+	for (i = 0; i < LAT_BUCKETS; i++)
+	{
+		seen += h->buckets[i];
+		if (seen >= rank)
+			break;
+	}
+	if (i < LAT_SUB)
+		hi = i;
+	else
+	{
+		shift = i / LAT_SUB - 1;
+		hi = ((uint64_t)(LAT_SUB + i % LAT_SUB) << shift) + ((uint64_t)1 << shift) - 1;
+	}
+	return (hi < h->max) ? hi : h->max;
+}
+
+/*
+ * lat_overhead - The cost of taking two stamps back to back, which
+ *     every recorded latency includes. The minimum of many tries is
+ *     used, as the cost of the call itself can't be smaller.
+ */
+uint64_t lat_overhead(void)
+{
+	uint64_t best = UINT64_MAX, t0, t1;
+	int i;
+
+	for (i = 0; i < 1000; i++)
+	{
+		t0 = lat_now();
+		t1 = lat_now();
+		if (t1 - t0 < best)
+			best = t1 - t0;
+	}
+	return best;
+}
+
+/*
+ * lat_unit - What lat_now counts
+ */
+const char *lat_unit(void)
+{
+#if defined(__x86_64__) || defined(__i386__)
+	return "cycles";
+#else
+	return "ns";
+#endif
+}
@@ -0,0 +1,109 @@
+/*
+ * latency.h - Per-request latency histograms for the malloc lab driver
+ *
+ * With -L the driver replays each trace once more and reads the time
+ * stamp counter around every call to the package. The latencies go
+ * into one log-linear histogram per request type: values below
+ * LAT_SUB are counted exactly, and every power of two above that is
+ * split into LAT_SUB equal buckets, so a percentile is accurate to
+ * about 1/LAT_SUB of its value whatever its size. The LAT_TOP slowest
+ * requests are also kept, so they can be found in the trace.
+ */
+#ifndef __LATENCY_H_
+#define __LATENCY_H_
+
+#include <stddef.h>
+#include <stdint.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#else
+#include <time.h>
+#endif
+
+#define LAT_SUB_BITS 5					/* log2 of the buckets per power of two */
+#define LAT_SUB (1 << LAT_SUB_BITS)
+#define LAT_BUCKETS ((64 - LAT_SUB_BITS + 1) * LAT_SUB) /* enough for any uint64_t */
+#define LAT_TYPES 3						/* ALLOC, FREE, REALLOC */
+#define LAT_TOP 5						/* slowest requests kept per trace */
+
+/* The latencies of one request type */
+typedef struct
+{
+	uint64_t count;				   /* requests recorded */
+	uint64_t max;				   /* slowest of them */
+	double sum;					   /* for the mean */
+	uint64_t buckets[LAT_BUCKETS]; /* requests per bucket */
+} lathist_t;
+
+/* One of the slowest requests */
+typedef struct
+{
+	uint64_t ticks; /* its latency */
+	int opnum;		/* its request number in the trace */
+	int type;		/* ALLOC, FREE or REALLOC */
+	size_t size;	/* bytes requested (0 for free) */
+} latop_t;
+
+/* The latencies of all requests of one trace */
+typedef struct
+{
+	lathist_t hist[LAT_TYPES]; /* indexed by request type */
+	latop_t top[LAT_TOP];	   /* slowest first */
+	int ntop;				   /* entries in top[] */
+} latency_t;
+
+void lat_reset(latency_t *lat);
+uint64_t lat_percentile(const lathist_t *h, double pct);
+uint64_t lat_overhead(void);
+const char *lat_unit(void);
+void lat_add_top(latency_t *lat, int type, int opnum, size_t size, uint64_t ticks);
+
+/*
+ * lat_now - Read the time stamp counter. rdtscp waits for the
+ *     instructions before it to finish, so the call being timed can't
+ *     leak past the stamp that ends it. Other machines use the
+ *     monotonic clock in nanoseconds.
+ */
+static inline uint64_t lat_now(void)
+{
+#if defined(__x86_64__) || defined(__i386__)
+	unsigned int aux;
+	return __rdtscp(&aux);
+#else
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+#endif
+}
+
+/*
+ * lat_bucket - Index of the histogram bucket that counts ticks
+ */
+static inline int lat_bucket(uint64_t ticks)
+{
+	int shift;
+
+	if (ticks < LAT_SUB)
+		return (int)ticks;
+	shift = 63 - __builtin_clzll(ticks) - LAT_SUB_BITS;
+	return (shift + 1) * LAT_SUB + (int)(ticks >> shift) - LAT_SUB;
+}
+
+/*
+ * lat_record - Count one request of the given type that took ticks
+ */
+static inline void lat_record(latency_t *lat, int type, int opnum, size_t size,
+							  uint64_t ticks)
+{
+	lathist_t *h = &lat->hist[type];
+
+	h->count++;
+	h->sum += ticks;
+	h->buckets[lat_bucket(ticks)]++;
+	if (ticks > h->max)
+		h->max = ticks;
+	if (lat->ntop < LAT_TOP || ticks > lat->top[LAT_TOP - 1].ticks)
+		lat_add_top(lat, type, opnum, size, ticks);
+}
+
+#endif /* __LATENCY_H_ */
@@ -2,7 +2,12 @@
  * memlib.c - a module that simulates the memory system.  Needed because it 
  *            allows us to interleave calls from the student's malloc package 
  *            with the system's malloc package in libc.
+ *
+ *            The heap lives in a virtual range reserved with mmap(PROT_NONE)
+ *            at mem_init time. Pages are committed (made read/write) as the
+ *            brk grows, so a large limit costs nothing until it is used.
  */
+#define _GNU_SOURCE           /* mremap */
 #include <stdio.h>
 #include <stdlib.h>
 #include <assert.h>
@@ -10,28 +15,126 @@
 #include <sys/mman.h>
 #include <string.h>
 #include <errno.h>
+#include <pthread.h>
 
 #include "memlib.h"
 #include "config.h"
 
+static int mem_commit(char *lo, char *hi);
+static int mem_region_len(size_t len, size_t *total);
+static void mem_release_above(char *new_brk, char *old_brk);
+static void mem_update_peak(void);
+static void mem_register_fork(void);
+static void mem_lock_regions(void);
+static void mem_unlock_regions(void);
+
 /* private variables */
 static char *mem_start_brk;  /* points to first byte of heap */
 static char *mem_brk;        /* points to last byte of heap */
 static char *mem_max_addr;   /* largest legal heap address */ 
+static size_t mem_peak;      /* largest heap size since the last reset */
+static char *mem_commit_brk; /* pages below this are committed read/write */
+static char *mem_map_base;   /* start of the whole reservation */
+static size_t mem_map_len;   /* length of the whole reservation */
+static size_t mem_limit = MAX_HEAP; /* heap size limit (mem_set_limit) */
+static int mem_thp;          /* ask for transparent huge pages (mem_set_hugepages) */
+static size_t mem_release_pad = MEM_RELEASE_PAD; /* see mem_set_release_pad */
+
+/*
+ * Mapped regions: big blocks that a package maps outside the heap with
+ * mem_map. Each region starts with a region_t that links it into a
+ * list, so tracking them needs no storage of its own.
+ */
+typedef struct region {
+    struct region *next;
+    struct region *prev;
+    size_t len;              /* whole mapping, including this header */
+    size_t pad;              /* keeps the caller's area 16-byte aligned */
+} region_t;
+
+static region_t *mem_regions;  /* all live mapped regions */
+static size_t mem_mapped;      /* bytes in mem_regions */
+static pthread_mutex_t mem_region_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_once_t mem_fork_once = PTHREAD_ONCE_INIT;
+
+#define HUGE_PAGE (2 * (1 << 20))    /* x86-64 transparent huge page */
+#define COMMIT_CHUNK (64 * 1024)     /* commit granularity without huge pages */
+
+/*
+ * mem_set_limit - set the maximum heap size in bytes. Takes effect at
+ *    the next mem_init. The default is MAX_HEAP.
+ */
+void mem_set_limit(size_t bytes)
+{
+    mem_limit = bytes;
+}
+
+/*
+ * mem_set_release_pad - set how many bytes above the brk stay resident
+ *    when the heap shrinks (a hysteresis: a heap that shrinks and grows
+ *    back by less than this does not fault its pages in again). The
+ *    default is MEM_RELEASE_PAD; 0 releases every page at once.
+ */
+void mem_set_release_pad(size_t bytes)
+{
+    mem_release_pad = bytes;
+}
+
+/*
+ * mem_set_hugepages - if on, align the heap to a huge page and madvise
+ *    it with MADV_HUGEPAGE at the next mem_init.
+ */
+void mem_set_hugepages(int on)
+{
+    mem_thp = on;
+}
 
 /* 
  * mem_init - initialize the memory system model
  */
 void mem_init(void)
 {
-    /* allocate the storage we will use to model the available VM */
-    if ((mem_start_brk = (char *)malloc(MAX_HEAP)) == NULL) {
-	fprintf(stderr, "mem_init_vm: malloc error\n");
+    size_t align = mem_thp ? HUGE_PAGE : mem_pagesize();
+
+    /* reserve (but do not commit) the VM we will use to model the heap */
+    mem_map_len = mem_limit + align;
+    mem_map_base = mmap(NULL, mem_map_len, PROT_NONE,
+			MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    if (mem_map_base == MAP_FAILED) {
+	fprintf(stderr, "mem_init_vm: mmap error reserving %zu bytes\n", mem_map_len);
 	exit(1);
     }
+    mem_start_brk = (char *)(((size_t)mem_map_base + align - 1) & ~(align - 1));
+#ifdef MADV_HUGEPAGE
+    if (mem_thp && madvise(mem_start_brk, mem_limit, MADV_HUGEPAGE) < 0)
+	fprintf(stderr, "mem_init_vm: MADV_HUGEPAGE not supported, using normal pages\n");
+#endif
+
+    mem_max_addr = mem_start_brk + mem_limit;  /* max legal heap address */
+    mem_brk = mem_start_brk;                   /* heap is empty initially */
+    mem_commit_brk = mem_start_brk;            /* nothing committed yet */
+    mem_peak = 0;
+
+    /* a fork while another thread holds the region lock would leave it held in the child */
+    pthread_once(&mem_fork_once, mem_register_fork);
+}
+
+/*
+ * mem_register_fork - hold the region lock across fork
+ */
+static void mem_register_fork(void)
+{
+    pthread_atfork(mem_lock_regions, mem_unlock_regions, mem_unlock_regions);
+}
 
-    mem_max_addr = mem_start_brk + MAX_HEAP;  /* max legal heap address */
-    mem_brk = mem_start_brk;                  /* heap is empty initially */
+static void mem_lock_regions(void)
+{
+    pthread_mutex_lock(&mem_region_lock);
+}
+
+static void mem_unlock_regions(void)
+{
+    pthread_mutex_unlock(&mem_region_lock);
 }
 
 /* 
@@ -39,7 +142,7 @@ void mem_init(void)
  */
 void mem_deinit(void)
 {
-    free(mem_start_brk);
+    munmap(mem_map_base, mem_map_len);
 }
 
 /*
@@ -47,27 +150,289 @@ void mem_deinit(void)
  */
 void mem_reset_brk()
 {
+    /* regions left over from the last run go away with the heap */
+    while (mem_regions != NULL)
+	mem_unmap(mem_regions + 1);
     mem_brk = mem_start_brk;
+    mem_peak = 0;
 }
 
 /* 
  * mem_sbrk - simple model of the sbrk function. Extends the heap 
- *    by incr bytes and returns the start address of the new area. In
- *    this model, the heap cannot be shrunk.
+ *    by incr bytes and returns the start address of the new area.
+ *    A negative incr shrinks the heap and returns the old brk (see
+ *    mem_shrink for the pages that go back to the OS). The brk is bumped
+ *    with an atomic compare-and-swap, so several threads may call
+ *    mem_sbrk concurrently.
  */
-void *mem_sbrk(int incr) 
+void *mem_sbrk(intptr_t incr) 
 {
-    char *old_brk = mem_brk;
+    char *old_brk = __atomic_load_n(&mem_brk, __ATOMIC_RELAXED);
 
-    if ( (incr < 0) || ((mem_brk + incr) > mem_max_addr)) {
+    do {
+	if ((old_brk + incr) > mem_max_addr) {
+	    errno = ENOMEM;
+	    fprintf(stderr, "ERROR: mem_sbrk failed. Ran out of memory...\n");
+	    return (void *)-1;
+	}
+	if ((old_brk + incr) < mem_start_brk) {
+	    errno = EINVAL;
+	    fprintf(stderr, "ERROR: mem_sbrk failed. Attempt to shrink below the heap start...\n");
+	    return (void *)-1;
+	}
+    } while (!__atomic_compare_exchange_n(&mem_brk, &old_brk, old_brk + incr,
+					  1, __ATOMIC_ACQ_REL, __ATOMIC_RELAXED));
+
+    if (old_brk + incr > __atomic_load_n(&mem_commit_brk, __ATOMIC_ACQUIRE)
+	&& mem_commit(old_brk, old_brk + incr) < 0) {
+	/* give the range back if nobody has moved the brk past it since */
+	char *new_brk = old_brk + incr;
+	__atomic_compare_exchange_n(&mem_brk, &new_brk, old_brk,
+				    0, __ATOMIC_ACQ_REL, __ATOMIC_RELAXED);
 	errno = ENOMEM;
-	fprintf(stderr, "ERROR: mem_sbrk failed. Ran out of memory...\n");
+	fprintf(stderr, "ERROR: mem_sbrk failed. Could not commit heap pages...\n");
 	return (void *)-1;
     }
-    mem_brk += incr;
+
+    if (incr < 0)
+	mem_release_above(old_brk + incr, old_brk);
+    else
+	mem_update_peak();
     return (void *)old_brk;
 }
 
+/*
+ * mem_shrink - lower the brk from brk to brk - len, but only if it is
+ *    still at brk: returns 0, or -1 if another thread has moved it in
+ *    the meantime (the heap is then left alone). Lets an arena that
+ *    owns the top of a shared heap give it back without racing the
+ *    others' mem_sbrk. The whole pages more than the release pad above
+ *    the new brk are released to the OS.
+ */
+int mem_shrink(void *brk, size_t len)
+{
+    char *old_brk = brk;
+
+    if (len > (size_t)(old_brk - mem_start_brk) ||
+	!__atomic_compare_exchange_n(&mem_brk, &old_brk, old_brk - len,
+				     0, __ATOMIC_ACQ_REL, __ATOMIC_RELAXED))
+	return -1;
+    mem_release_above(old_brk - len, old_brk);
+    return 0;
+}
+
+/*
+ * mem_release_above - release what the brk's drop from old_brk to
+ *    new_brk uncovered, keeping mem_release_pad bytes above new_brk
+ *    resident. What lies above old_brk + pad went at earlier shrinks.
+ */
+static void mem_release_above(char *new_brk, char *old_brk)
+{
+    char *lo = new_brk + mem_release_pad;
+    char *hi = old_brk + mem_release_pad;
+    char *commit = __atomic_load_n(&mem_commit_brk, __ATOMIC_ACQUIRE);
+
+    if (hi > commit)
+	hi = commit;
+    if (hi > lo)
+	mem_release(lo, hi - lo);
+}
+
+/*
+ * mem_update_peak - raise mem_peak to the current footprint (heap
+ *    plus mapped regions) if it is higher.
+ */
+static void mem_update_peak(void)
+{
+    size_t size = mem_heapsize() + __atomic_load_n(&mem_mapped, __ATOMIC_RELAXED);
+    size_t peak = __atomic_load_n(&mem_peak, __ATOMIC_RELAXED);
+
+    while (size > peak &&
+	   !__atomic_compare_exchange_n(&mem_peak, &peak, size,
+					1, __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+	;
+}
+
+/*
+ * mem_map - map a region of at least len bytes outside the heap and
+ *    return its 16-byte aligned start, or NULL if mmap fails. The
+ *    region counts toward the footprint until it is unmapped.
+ */
+void *mem_map(size_t len)
+{
+    size_t total;
+    region_t *r;
+
+    if (mem_region_len(len, &total) < 0)
+	return NULL;
+    r = mmap(NULL, total, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (r == MAP_FAILED)
+	return NULL;
+    r->len = total;
+
+    pthread_mutex_lock(&mem_region_lock);
+    r->prev = NULL;
+    r->next = mem_regions;
+    if (mem_regions != NULL)
+	mem_regions->prev = r;
+    mem_regions = r;
+    __atomic_add_fetch(&mem_mapped, total, __ATOMIC_RELAXED);
+    pthread_mutex_unlock(&mem_region_lock);
+
+    mem_update_peak();
+    return r + 1;
+}
+
+/*
+ * mem_region_len - store in *total the whole pages that a region of
+ *    len usable bytes maps, header included. Returns -1 (ENOMEM) if
+ *    that is more than a size_t can hold, which a request near
+ *    SIZE_MAX would otherwise wrap around to a one-page mapping.
+ */
+static int mem_region_len(size_t len, size_t *total)
+{
+    size_t pagesize = mem_pagesize();
+
+    if (__builtin_add_overflow(len, sizeof(region_t) + pagesize - 1, total)) {
+	errno = ENOMEM;
+	return -1;
+    }
+    *total &= ~(pagesize - 1);
+    return 0;
+}
+
+/*
+ * mem_unmap - unmap a region returned by mem_map or mem_remap
+ */
+void mem_unmap(void *addr)
+{
+    region_t *r = (region_t *)addr - 1;
+
+    pthread_mutex_lock(&mem_region_lock);
+    if (r->prev) r->prev->next = r->next;
+    else         mem_regions = r->next;
+    if (r->next) r->next->prev = r->prev;
+    __atomic_sub_fetch(&mem_mapped, r->len, __ATOMIC_RELAXED);
+    pthread_mutex_unlock(&mem_region_lock);
+
+    munmap(r, r->len);
+}
+
+/*
+ * mem_remap - resize a mapped region to at least len bytes. The kernel
+ *    moves the pages instead of copying them, so the region may come
+ *    back at a new address. Returns NULL (and leaves the region alone)
+ *    if mremap fails.
+ */
+void *mem_remap(void *addr, size_t len)
+{
+    size_t total;
+    region_t *r = (region_t *)addr - 1;
+    region_t *nr;
+    size_t old_len;
+
+    if (mem_region_len(len, &total) < 0)
+	return NULL;
+    /* hold the lock while the region moves so nobody walks a stale link */
+    pthread_mutex_lock(&mem_region_lock);
+    old_len = r->len;
+    nr = mremap(r, old_len, total, MREMAP_MAYMOVE);
+    if (nr == MAP_FAILED) {
+	pthread_mutex_unlock(&mem_region_lock);
+	return NULL;
+    }
+    nr->len = total;
+    if (nr->prev) nr->prev->next = nr;
+    else          mem_regions = nr;
+    if (nr->next) nr->next->prev = nr;
+    __atomic_add_fetch(&mem_mapped, total - old_len, __ATOMIC_RELAXED);
+    pthread_mutex_unlock(&mem_region_lock);
+
+    mem_update_peak();
+    return nr + 1;
+}
+
+/*
+ * mem_region_size - returns the usable bytes of a mapped region, which
+ *    is the length asked for rounded up to whole pages
+ */
+size_t mem_region_size(void *addr)
+{
+    region_t *r = (region_t *)addr - 1;
+
+    return r->len - sizeof(region_t);
+}
+
+/*
+ * mem_is_mapped - return 1 if [lo, hi] lies inside one mapped region
+ */
+int mem_is_mapped(void *lo, void *hi)
+{
+    region_t *r;
+    int found = 0;
+
+    pthread_mutex_lock(&mem_region_lock);
+    for (r = mem_regions; r != NULL; r = r->next) {
+	if ((char *)lo >= (char *)(r + 1) && (char *)hi < (char *)r + r->len) {
+	    found = 1;
+	    break;
+	}
+    }
+    pthread_mutex_unlock(&mem_region_lock);
+    return found;
+}
+
+/*
+ * mem_mapped_bytes - returns the bytes currently in mapped regions
+ */
+size_t mem_mapped_bytes()
+{
+    return __atomic_load_n(&mem_mapped, __ATOMIC_RELAXED);
+}
+
+/*
+ * mem_commit - make the pages covering [lo, hi) read/write. The
+ *    range is widened to whole commit chunks so that small sbrk steps
+ *    do not each cost a system call. mem_commit_brk only moves up after
+ *    mprotect returns, so a thread that sees its range below it may
+ *    touch the pages at once.
+ */
+static int mem_commit(char *lo, char *hi)
+{
+    size_t chunk = mem_thp ? HUGE_PAGE : COMMIT_CHUNK;
+    size_t pagesize = mem_pagesize();
+    char *start = (char *)((size_t)lo & ~(pagesize - 1));
+    char *end = mem_start_brk + (((size_t)(hi - mem_start_brk) + chunk - 1) & ~(chunk - 1));
+    char *old;
+
+    if (end > mem_max_addr)
+	end = mem_max_addr;
+    if (mprotect(start, end - start, PROT_READ | PROT_WRITE) < 0)
+	return -1;
+
+    old = __atomic_load_n(&mem_commit_brk, __ATOMIC_RELAXED);
+    while (end > old &&
+	   !__atomic_compare_exchange_n(&mem_commit_brk, &old, end,
+					1, __ATOMIC_RELEASE, __ATOMIC_RELAXED))
+	;
+    return 0;
+}
+
+/*
+ * mem_release - tell the OS that the whole pages inside [addr, addr+len)
+ *    are no longer needed. The range stays part of the heap; the pages
+ *    read back as zeros and are faulted in again on the next touch.
+ */
+void mem_release(void *addr, size_t len)
+{
+    size_t pagesize = mem_pagesize();
+    size_t lo = ((size_t)addr + pagesize - 1) & ~(pagesize - 1);
+    size_t hi = ((size_t)addr + len) & ~(pagesize - 1);
+
+    if (hi > lo)
+	madvise((void *)lo, hi - lo, MADV_DONTNEED);
+}
+
 /*
  * mem_heap_lo - return address of the first heap byte
  */
@@ -81,7 +446,7 @@ void *mem_heap_lo()
  */
 void *mem_heap_hi()
 {
-    return (void *)(mem_brk - 1);
+    return (void *)(__atomic_load_n(&mem_brk, __ATOMIC_RELAXED) - 1);
 }
 
 /*
@@ -89,7 +454,26 @@ void *mem_heap_hi()
  */
 size_t mem_heapsize() 
 {
-    return (size_t)(mem_brk - mem_start_brk);
+    return (size_t)(__atomic_load_n(&mem_brk, __ATOMIC_RELAXED) - mem_start_brk);
+}
+
+/*
+ * mem_max_heapsize() - returns the heap size limit in bytes
+ */
+size_t mem_max_heapsize()
+{
+    return mem_limit;
+}
+
+/*
+ * mem_peak_heapsize() - returns the largest footprint (heap plus
+ *    mapped regions) reached since the last mem_init/mem_reset_brk.
+ *    Equal to mem_heapsize() for a package that never shrinks the
+ *    heap or maps regions.
+ */
+size_t mem_peak_heapsize()
+{
+    return __atomic_load_n(&mem_peak, __ATOMIC_RELAXED);
 }
 
 /*
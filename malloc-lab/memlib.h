@@ -1,11 +1,25 @@
 #include <unistd.h>
+#include <stdint.h>
 
+void mem_set_limit(size_t bytes);
+void mem_set_hugepages(int on);
+void mem_set_release_pad(size_t bytes);
 void mem_init(void);               
 void mem_deinit(void);
-void *mem_sbrk(int incr);
+void *mem_sbrk(intptr_t incr);
+int mem_shrink(void *brk, size_t len);
+void mem_release(void *addr, size_t len);
+void *mem_map(size_t len);
+void mem_unmap(void *addr);
+void *mem_remap(void *addr, size_t len);
+size_t mem_region_size(void *addr);
+int mem_is_mapped(void *lo, void *hi);
+size_t mem_mapped_bytes(void);
 void mem_reset_brk(void); 
 void *mem_heap_lo(void);
 void *mem_heap_hi(void);
 size_t mem_heapsize(void);
+size_t mem_peak_heapsize(void);
+size_t mem_max_heapsize(void);
 size_t mem_pagesize(void);
 
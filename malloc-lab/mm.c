@@ -3,9 +3,21 @@
 #include <assert.h>
 #include <unistd.h>
 #include <string.h>
+#include <stdint.h>
+#include <sys/mman.h>
 
 #include "mm.h"
 #include "memlib.h"
+#include "config.h"
+
+/* make THREADED=1 로 빌드하면 스레드별 arena를 쓰는 thread-safe 모드 */
+#ifndef MM_THREADED
+#define MM_THREADED 0
+#endif
+
+#if MM_THREADED
+#include <pthread.h>
+#endif
 
 /*********************************************************
  * NOTE TO STUDENTS: Before you do anything else, please
@@ -24,27 +36,52 @@ team_t team = {
     ""};
 
 /* Basic constants and macros */
-#define WSIZE 4       /* 64비트 기준 1워드 크기를 8바이트로 정의 => 헤더와 푸터의 크기로 사용 */
-#define DSIZE 8         /* 더블 워드의 크기는 16바이트 => 메모리 정렬의 기본 단위로 사용 */
+/*
+ * MM_WIDE: 헤더/푸터를 8바이트 워드로 쓰는 64비트 모드 (make WIDE=1)
+ * - 크기 필드가 size_t라서 블록 하나가 2GB를 넘을 수 있다
+ * - 정렬은 16바이트 (config.h의 ALIGNMENT도 같이 바뀜)
+ * 기본 모드는 4바이트 워드 + 8바이트 정렬 (블록 크기 2GB 미만)
+ */
+#if MM_WIDE
+#define WSIZE 8       /* 64비트 기준 1워드 크기를 8바이트로 정의 => 헤더와 푸터의 크기로 사용 */
+#define DSIZE 16        /* 더블 워드의 크기는 16바이트 => 메모리 정렬의 기본 단위로 사용 */
+typedef size_t word_t;
+#else
+#define WSIZE 4       /* 1워드 = 4바이트 헤더/푸터 */
+#define DSIZE 8         /* 더블 워드 = 8바이트 정렬 단위 */
+typedef unsigned int word_t;
+#endif
 #define CHUNKSIZE (1 << 12)         /* 힙 공간이 부족할 때, sbrk를 통해 추가로 요청할 메모리의 기본 크기 (4096바이트) */
-#define NUM_CLASSES 12              /* SEGREGATED: 사이즈 클래스 개수 */
+#define NUM_CLASSES 6               /* SEGREGATED: 사이즈 클래스 개수 (TREE_MIN 이하만 담당) */
 
 #define MAX(x, y) ((x) > (y) ? (x) : (y))
+#define MIN(x, y) ((x) < (y) ? (x) : (y))
 
 /* 헤더와 푸터 관리 유틸: 크기+할당비트를 한 워드로 PACK/GET/PUT */
 #define PACK(size, alloc) ((size) | (alloc))
 
-/* 64비트 환경이므로 size_t (보통 unsigned long)를 사용하여 8바이트 단위로 읽고 씀 */
-#define GET(p) (*(int *)(p))
-#define PUT(p, val) (*(int *)(p) = (val))
+/* 워드 타입(word_t) 단위로 읽고 씀 (MM_WIDE면 size_t, 아니면 4바이트) */
+#define GET(p) (*(word_t *)(p))
+#define PUT(p, val) (*(word_t *)(p) = (word_t)(val))
 
-/* 헤더/푸터의 크기/할당비트 추출 (16바이트 정렬 기준) */
-#define GET_SIZE(p) (GET(p) & ~0x7)
+/* 헤더/푸터의 크기/할당비트 추출 (하위 3비트는 태그) */
+#define GET_SIZE(p) (GET(p) & ~(word_t)0x7)
 #define GET_ALLOC(p) (GET(p) & 0x1)
 
+/*
+ * 헤더의 비트 1: 바로 앞 블록이 할당 상태인지(prev_alloc)
+ * 할당 블록에는 푸터가 없고 가용 블록만 푸터를 가진다.
+ * 그래서 앞 블록의 상태는 푸터가 아니라 내 헤더의 이 비트로 확인한다.
+ */
+#define PREV_ALLOC 0x2
+#define GET_PREV_ALLOC(p) (GET(p) & PREV_ALLOC)
+#define SET_PREV_ALLOC(p) PUT(p, GET(p) | PREV_ALLOC)
+#define CLR_PREV_ALLOC(p) PUT(p, GET(p) & ~PREV_ALLOC)
+
 /*
  * 블록 포인터(bp)를 가지고 헤더/푸터 주소 계산
  * bp는 항상 "payload의 시작"을 가리킨다.
+ * FTRP는 가용 블록에서만 의미가 있다. (할당 블록은 그 자리도 payload)
  */
 #define HDRP(bp) ((char *)(bp) - WSIZE)
 #define FTRP(bp) ((char *)(bp) + GET_SIZE(HDRP(bp)) - DSIZE)
@@ -52,6 +89,7 @@ team_t team = {
 /* 인접 블록의 bp 계산
  * NEXT_BLKP: 현재 블록의 총 크기만큼 전진 → 다음 블록의 payload 시작
  * PREV_BLKP: 현재 bp 바로 앞(=이전 블록 footer 위치)에서 size를 읽어 그만큼 후퇴 → 이전 블록 payload 시작
+ *            이전 블록이 가용일 때(GET_PREV_ALLOC == 0)만 footer가 있으므로 그때만 사용한다.
  */
 #define NEXT_BLKP(bp) ((char *)(bp) + GET_SIZE(HDRP(bp)))
 #define PREV_BLKP(bp) ((char *)(bp) - GET_SIZE(((char *)(bp) - DSIZE)))
@@ -64,24 +102,360 @@ team_t team = {
 #define SET_PRED(bp, p) (PRED_P(bp) = (p))
 #define SET_SUCC(bp, p) (SUCC_P(bp) = (p))
 
+/*
+ * TREE: TREE_MIN보다 큰 가용 블록은 리스트 대신 (size, 주소) 순서의 treap에 넣는다
+ * - 같은 payload 자리를 pred/succ 대신 left/right 자식 포인터로 쓴다
+ * - 우선순위는 주소의 해시라서 따로 저장할 필요가 없다
+ * - best-fit 탐색과 삭제가 모두 O(log n) (큰 블록이 많아져도 선형 스캔이 없음)
+ */
+#define TREE_MIN (MIN_BLK_SIZE << (NUM_CLASSES - 1))   /* 768바이트 (MM_WIDE: 1024바이트) */
+#define LEFT_P(bp) PRED_P(bp)
+#define RIGHT_P(bp) SUCC_P(bp)
+#define TREE_PRIO(bp) (((uintptr_t)(bp) * 0x9E3779B97F4A7C15ULL) >> 32)
+
 /* 가용 블록으로 분할이 가능하려면 최소한
  * Header(WSIZE) + Footer(WSIZE) + Pred_Pointer(PTRSIZE) + Succ_Pointer(PTRSIZE)
  * 이 필요하다. (= 2*WSIZE + 2*PTRSIZE)
- * 이보다 작은 잔여 공간은 쪼개지지 않고 통째로 할당해버리는 게 맞음. */
-#define MIN_BLK_SIZE (2 * WSIZE + 2 * PTRSIZE)   // 64bit 기준: 32바이트
+ * 이보다 작은 잔여 공간은 쪼개지지 않고 통째로 할당해버리는 게 맞음.
+ * 할당 블록은 헤더만 있으면 되지만, 해제되면 가용 블록이 되므로 최소 크기는 같다. */
+#define MIN_BLK_SIZE (2 * WSIZE + 2 * PTRSIZE)   // 64bit 기준: 24바이트 (MM_WIDE: 32바이트)
+
+/*
+ * PAGE MAP: 힙의 페이지(주소를 페이지 크기로 나눈 번호)마다 1바이트 속성
+ * - PAGE_SLAB: 이 페이지는 slab run이다 (헤더 없는 object들이 들어 있음)
+ * - PAGE_ARENA: 이 페이지를 소유한 arena 번호 (MM_THREADED)
+ * 포인터만 보고 블록의 종류와 주인을 알아내는 데 쓴다.
+ */
+#define PAGE_SHIFT 10                    /* page map 단위. OS 페이지가 아니라 slab run 크기 */
+#define PAGE_SIZE (1 << PAGE_SHIFT)
+#define ROUND_PAGE(x) (((x) + PAGE_SIZE - 1) & ~(size_t)(PAGE_SIZE - 1))
+#define PAGE_INDEX(p) (((uintptr_t)(p) >> PAGE_SHIFT) - heap_base_page)
+#define PAGE_SLAB 0x80
+#define PAGE_ARENA 0x7f
+#define IS_SLAB(p) (page_map[PAGE_INDEX(p)] & PAGE_SLAB)
+
+/*
+ * SLAB: SLAB_MAX 바이트 이하 요청은 find_fit까지 가지 않고 slab에서 처리
+ * - 클래스는 DSIZE 간격 (8, 16, ..., 64바이트)
+ * - run 하나는 페이지(PAGE_SIZE) 하나이고, 맨 앞에 slab_t,
+ *   그 뒤에 같은 크기의 object들이 헤더 없이 붙어 있다
+ * - run은 가용 리스트가 아니라 sbrk로 바로 받은 SLAB_CHUNK 단위 덩어리를 잘라 만든다.
+ *   (정렬 블록을 힙에서 받으면 run마다 앞쪽 자투리가 남아 find_fit이 느려진다)
+ *   비어 버린 run은 힙에 돌려주지 않고 spare 리스트에 두었다가 어느 클래스든 다시 쓴다
+ * - object가 어느 run 소속인지는 포인터를 페이지 크기로 마스킹해서 찾는다
+ * MM_SLAB=0으로 빌드하면 끈다. (작은 요청도 segregated list에서 처리)
+ */
+#ifndef MM_SLAB
+#define MM_SLAB 1
+#endif
+#define SLAB_MAX 64
+#define SLAB_CLASSES (SLAB_MAX / DSIZE)
+#define SLAB_CHUNK (4 * PAGE_SIZE)                      /* 한 번에 sbrk로 받는 run 묶음 */
+#define SLAB_RUN_BYTES PAGE_SIZE                        /* run 하나의 크기 */
+#define SLAB_MAP_WORDS ((SLAB_RUN_BYTES / DSIZE + 63) / 64)
+#define SLAB_HDR_SIZE (DSIZE * ((sizeof(slab_t) + DSIZE - 1) / DSIZE))
+#define SLAB_OF(p) ((slab_t *)((uintptr_t)(p) & ~(uintptr_t)(PAGE_SIZE - 1)))
+#define SLAB_OBJS(run) ((char *)(run) + SLAB_HDR_SIZE)
+
+typedef struct slab {
+    struct slab *next;                  /* 같은 클래스에서 빈 칸이 남은 run 리스트 */
+    struct slab *prev;
+    unsigned int size;                  /* object 크기 */
+    unsigned int nobjs;                 /* run에 들어가는 object 수 */
+    unsigned int nfree;                 /* 남은 빈 칸 수 */
+    unsigned int hint;                  /* 빈 칸 탐색을 시작할 bitmap 워드 */
+    unsigned long used[SLAB_MAP_WORDS]; /* 1 = 사용 중 */
+} slab_t;
+
+/*
+ * QUICK LIST: QUICK_MAX 이하 블록은 free 때 바로 병합하지 않고 크기별 LIFO에 쌓아 둔다
+ * - 리스트에 있는 블록은 헤더상 "할당" 상태 그대로라 이웃과 병합되지 않는다.
+ *   대신 헤더에 QUICK_TAG를 달아서 realloc이 "이웃이 퀵 리스트에 있다"를 알 수 있게 한다
+ * - 같은 크기의 malloc이 오면 분할/병합 없이 그대로 꺼내 준다
+ * - 쌓인 블록이 QUICK_LIMIT을 넘거나 find_fit이 실패하면 한꺼번에 풀어서 병합 (quick_flush)
+ * 기본 트레이스에서는 적중률이 낮고(binary 5%, coalescing 0%) realloc util과 처리량을
+ * 깎아서 기본으로는 끈다. MM_QUICKLIST=1로 빌드하면 켠다.
+ */
+#ifndef MM_QUICKLIST
+#define MM_QUICKLIST 0
+#endif
+#define QUICK_TAG 0x4          /* 힙 안 블록 헤더의 태그 (MAPPED는 힙 밖 블록에만 쓰므로 겹치지 않음) */
+#define QUICK_MAX 1024
+#define QUICK_CLASSES ((QUICK_MAX - MIN_BLK_SIZE) / DSIZE + 1)
+#define QUICK_INDEX(size) (((size) - MIN_BLK_SIZE) / DSIZE)
+#define QUICK_LIMIT 256
+#define QUICK_NEXT(bp) PRED_P(bp)
+
+/*
+ * TRIM: 다 쓴 메모리를 시스템에 돌려준다 (free 경로에서만)
+ * - 힙 맨 끝 가용 블록(wilderness)이 MM_TRIM_THRESHOLD를 넘으면 TRIM_PAD쯤만 남기고
+ *   mem_shrink로 brk를 내린다. MM_THREADED에서는 brk 맨 위를 가진 arena만 줄일 수 있고,
+ *   그 사이 다른 arena가 brk를 옮겼으면 mem_shrink가 실패하므로 그대로 둔다
+ *   남겨 두는 TRIM_PAD가 히스테리시스: 줄인 직후의 할당이 곧바로 힙을 다시 늘리지 않는다
+ * - 그 밖에 병합 결과가 RELEASE_MIN 이상인 가용 블록은 payload 가운데의 페이지들을
+ *   mem_release로 반납한다 (불변식: RELEASE_MIN 이상인 가용 블록의 가운데는 반납된 상태)
+ * (brk를 내려도 memlib이 새 brk 위 MEM_RELEASE_PAD(기본 1MB, make RELEASE_PAD=)까지는
+ *  페이지를 남겨 두므로 힙이 조금 줄었다 늘었다 해도 page fault가 반복되지 않는다)
+ * MM_TRIM_THRESHOLD=0으로 빌드하면 둘 다 끈다.
+ */
+#ifndef MM_TRIM_THRESHOLD
+#define MM_TRIM_THRESHOLD (128 * 1024)
+#endif
+#define TRIM_PAD (MM_TRIM_THRESHOLD / 2)
+#define RELEASE_MIN MM_TRIM_THRESHOLD
+
+/*
+ * MMAP: MM_MMAP_THRESHOLD 이상 요청은 힙을 늘리지 않고 mem_map으로 따로 매핑한다
+ * - 헤더에는 크기 대신 MAPPED 태그를 둔다 (쓸 수 있는 크기는 mem_region_size로 확인)
+ * - free는 바로 mem_unmap, realloc은 mem_remap (커널이 페이지를 옮기므로 memcpy 없음)
+ * - slab object는 헤더가 없으므로 "힙 밖에 있다"를 먼저 확인하고 태그를 읽는다
+ * MM_MMAP_THRESHOLD=0으로 빌드하면 끈다 (모든 요청이 힙에서 나온다)
+ */
+#ifndef MM_MMAP_THRESHOLD
+#define MM_MMAP_THRESHOLD (128 * 1024)
+#endif
+#define MAPPED 0x4
+#define MAP_OVERHEAD DSIZE                                      /* 패딩 + 헤더 */
+#define MAP_SIZE(bp) (mem_region_size((char *)(bp) - MAP_OVERHEAD) - MAP_OVERHEAD)  /* payload 용량 */
+#define IN_HEAP(bp) ((size_t)((char *)(bp) - (char *)mem_heap_lo()) < mem_heapsize())
+#define IS_MAPPED(bp) (!IN_HEAP(bp) && (GET(HDRP(bp)) & MAPPED))
+
+/*
+ * ARENA: 가용 리스트 한 벌과 그 리스트가 관리하는 힙 세그먼트들
+ * 단일 스레드 빌드에서는 arena가 하나뿐이고 힙도 한 세그먼트로 이어진다.
+ * MM_THREADED 빌드에서는 스레드마다 arena를 배정하고, 각 arena는 공유
+ * mem_sbrk 영역에서 페이지 단위 세그먼트를 떼어 간다. 세그먼트 양 끝의
+ * prologue/epilogue가 다른 arena 영역과의 병합을 막는다.
+ */
+#if MM_THREADED
+#define NUM_ARENAS 8                /* 스레드는 라운드 로빈으로 arena에 배정 */
+#define LOCK(ar) pthread_mutex_lock(&(ar)->lock)
+#define UNLOCK(ar) pthread_mutex_unlock(&(ar)->lock)
+#else
+#define NUM_ARENAS 1
+#define LOCK(ar)
+#define UNLOCK(ar)
+#endif
+
+/* 새 세그먼트의 경계 비용: 정렬 패딩 + prologue 헤더/푸터 + epilogue 헤더 */
+#define SEG_OVERHEAD (4 * WSIZE)
+
+typedef struct arena {
+    void *segregated_lists[NUM_CLASSES]; /* SEGREGATED: 사이즈 클래스별 가용 리스트의 시작점을 담는 배열 */
+    void *size_tree;                     /* TREE: TREE_MIN보다 큰 가용 블록들의 treap 루트 */
+    char *heap_end;                      /* 마지막 세그먼트의 끝(epilogue 바로 뒤). 이어붙일 수 있는지 판단용 */
+    slab_t *slabs[SLAB_CLASSES];         /* SLAB: 클래스별로 빈 칸이 남은 run 리스트 */
+    slab_t *spare_runs;                  /* SLAB: 완전히 빈 run 리스트 (next로 연결) */
+#if MM_QUICKLIST
+    void *quick[QUICK_CLASSES];          /* QUICK: 크기별로 병합을 미뤄 둔 블록 (LIFO) */
+    unsigned int quick_count;            /* 지금 미뤄 둔 블록 수 */
+    unsigned long quick_hits;            /* 통계: 퀵 리스트에서 바로 꺼내 준 횟수 */
+    unsigned long quick_misses;          /* 통계: 퀵 리스트 크기인데 비어 있던 횟수 */
+    unsigned long quick_flushes;         /* 통계: 일괄 병합 횟수 */
+#endif
+#if MM_THREADED
+    pthread_mutex_t lock;
+#endif
+} arena_t;
 
 /* static 전역 포인터들 */
 static void *heap_listp;                    /* Implicit 순회를 위한 포인터 */
-static void *segregated_lists[NUM_CLASSES]; /* SEGREGATED: 사이즈 클래스별 가용 리스트의 시작점을 담는 배열 */
+static arena_t arenas[NUM_ARENAS];
+static uintptr_t heap_base_page;            /* 힙 첫 바이트의 페이지 번호 */
+static unsigned char *page_map;              /* 힙 페이지 -> PAGE_SLAB | arena 번호 */
+static size_t page_map_len;                 /* page_map 바이트 수 (힙 한도 / PAGE_SIZE) */
+
+#if MM_THREADED
+static int arenas_ready;                    /* mutex 초기화 여부 */
+static unsigned arena_gen;                  /* mm_init마다 증가: 스레드별 배정을 무효화 */
+static unsigned next_arena;                 /* 라운드 로빈 배정 카운터 */
+static __thread arena_t *my_arena;
+static __thread unsigned my_gen;
+#endif
+
+/* mdriver -T는 이 값이 0이 아닌 패키지만 여러 스레드로 돌린다 */
+const int mm_thread_safe = MM_THREADED;
 
 /* 함수 프로토타입 */
-static void *extend_heap(size_t words);
-static void *coalesce(void *bp);
-static void *find_fit(size_t asize);
-static void place(void *bp, size_t asize);
-static void insert_block(void *bp);
-static void remove_block(void *bp);
+static void *extend_heap(arena_t *ar, size_t words);
+static void *coalesce(arena_t *ar, void *bp);
+static void *find_fit(arena_t *ar, size_t asize);
+static void place(arena_t *ar, void *bp, size_t asize);
+static void insert_block(arena_t *ar, void *bp);
+static void remove_block(arena_t *ar, void *bp);
+static void *tree_insert(void *root, void *bp);
+static void *tree_remove(void *root, void *bp);
+static void *tree_best_fit(void *root, size_t asize);
 static int get_list_index(size_t size);
+static size_t adjust_size(size_t size);
+static arena_t *thread_arena(void);
+static arena_t *block_arena(void *bp);
+static void *arena_malloc(arena_t *ar, size_t asize);
+static void arena_free(arena_t *ar, void *bp);
+static void trim_block(arena_t *ar, void *bp, char *lo, char *hi);
+static void *alloc_aligned(arena_t *ar, size_t align, size_t asize);
+#if MM_SLAB
+static void *slab_alloc(arena_t *ar, size_t size);
+static slab_t *slab_run(arena_t *ar);
+#endif
+static void slab_free(arena_t *ar, void *p);
+static void *map_alloc(size_t size);
+#if MM_THREADED
+static void lock_arenas(void);
+static void unlock_arenas(void);
+#endif
+#if MM_QUICKLIST
+static void quick_flush(arena_t *ar);
+#endif
+
+/*
+ * [arena helper] 현재 스레드의 arena. 처음 호출했거나 mm_init 이후라면 새로 배정
+ */
+static arena_t *thread_arena(void) {
+#if MM_THREADED
+    unsigned gen = __atomic_load_n(&arena_gen, __ATOMIC_ACQUIRE);
+    if (my_arena == NULL || my_gen != gen) {
+        unsigned id = __atomic_fetch_add(&next_arena, 1, __ATOMIC_RELAXED);
+        my_arena = &arenas[id % NUM_ARENAS];
+        my_gen = gen;
+    }
+    return my_arena;
+#else
+    return &arenas[0];
+#endif
+}
+
+/*
+ * [arena helper] 블록을 소유한 arena. 다른 스레드가 free해도 원래 arena로 돌려보낸다
+ */
+static arena_t *block_arena(void *bp) {
+#if MM_THREADED
+    return &arenas[page_map[PAGE_INDEX(bp)] & PAGE_ARENA];
+#else
+    (void)bp;
+    return &arenas[0];
+#endif
+}
+
+#if MM_THREADED
+/*
+ * [arena helper] fork 직전에 모든 arena를 잠그고, 직후 부모/자식 양쪽에서 푼다
+ * 다른 스레드가 arena를 잡은 채로 fork되면 자식에서는 영영 풀리지 않기 때문
+ */
+static void lock_arenas(void) {
+    for (int a = 0; a < NUM_ARENAS; a++)
+        LOCK(&arenas[a]);
+}
+
+static void unlock_arenas(void) {
+    for (int a = NUM_ARENAS - 1; a >= 0; a--)
+        UNLOCK(&arenas[a]);
+}
+#endif
+
+#if MM_SLAB
+/*
+ * [slab helper] 빈 run 하나를 spare 리스트에서 꺼낸다
+ * 비어 있으면 brk를 페이지 경계로 맞춘 뒤 SLAB_CHUNK를 받아 run들로 자른다.
+ * 힙 세그먼트 사이에 끼므로 다음 extend_heap은 새 세그먼트를 연다.
+ * (MM_THREADED에서는 brk가 늘 페이지 배수라 패딩이 생기지 않는다)
+ */
+static slab_t *slab_run(arena_t *ar) {
+    slab_t *run = ar->spare_runs;
+
+    if (run == NULL) {
+        uintptr_t brk = (uintptr_t)mem_heap_hi() + 1;
+        size_t pad = ROUND_PAGE(brk) - brk;
+        char *p = mem_sbrk(pad + SLAB_CHUNK);
+
+        if ((long)p == -1)
+            return NULL;
+        p += pad;
+        memset(&page_map[PAGE_INDEX(p)], PAGE_SLAB | (int)(ar - arenas),
+               SLAB_CHUNK / PAGE_SIZE);
+        for (char *q = p + SLAB_CHUNK - PAGE_SIZE; q >= p; q -= PAGE_SIZE) {
+            ((slab_t *)q)->next = run;
+            run = (slab_t *)q;
+        }
+    }
+    ar->spare_runs = run->next;
+    return run;
+}
+
+/*
+ * [slab helper] size 바이트 object를 slab에서 꺼낸다
+ * 빈 칸이 남은 run이 없으면 빈 run을 하나 받아 이 클래스로 초기화한다
+ */
+static void *slab_alloc(arena_t *ar, size_t size) {
+    int cls = (int)((size + DSIZE - 1) / DSIZE) - 1;
+    slab_t *run = ar->slabs[cls];
+    unsigned int w, bit;
+
+    if (run == NULL) {
+        if ((run = slab_run(ar)) == NULL)
+            return NULL;
+
+        run->size = (cls + 1) * DSIZE;
+        run->nobjs = (SLAB_RUN_BYTES - SLAB_HDR_SIZE) / run->size;
+        run->nfree = run->nobjs;
+        run->hint = 0;
+        memset(run->used, 0, sizeof(run->used));
+        /* 마지막 워드에서 nobjs를 넘는 비트는 미리 사용 중으로 막아 둔다 */
+        for (bit = run->nobjs; bit < SLAB_MAP_WORDS * 64; bit++)
+            run->used[bit / 64] |= 1UL << (bit % 64);
+
+        run->prev = NULL;
+        run->next = NULL;
+        ar->slabs[cls] = run;
+    }
+
+    for (w = run->hint; ~run->used[w] == 0; w++)
+        ;
+    bit = __builtin_ctzl(~run->used[w]);
+    run->used[w] |= 1UL << bit;
+    run->hint = w;
+
+    /* 꽉 찬 run은 리스트에서 뺀다. free가 일어나면 다시 들어온다 */
+    if (--run->nfree == 0) {
+        ar->slabs[cls] = run->next;
+        if (run->next)
+            run->next->prev = NULL;
+    }
+    return SLAB_OBJS(run) + (w * 64 + bit) * run->size;
+}
+#endif
+
+/*
+ * [slab helper] object를 run에 돌려준다
+ * run이 완전히 비면 spare 리스트로 보낸다. (클래스의 마지막 run은 남겨서 왕복을 막음)
+ */
+static void slab_free(arena_t *ar, void *p) {
+    slab_t *run = SLAB_OF(p);
+    int cls = run->size / DSIZE - 1;
+    unsigned int idx = ((char *)p - SLAB_OBJS(run)) / run->size;
+
+    run->used[idx / 64] &= ~(1UL << (idx % 64));
+    if (idx / 64 < run->hint)
+        run->hint = idx / 64;
+
+    if (run->nfree++ == 0) {
+        /* 꽉 차 있던 run: 다시 빈 칸 있는 리스트로 */
+        run->prev = NULL;
+        run->next = ar->slabs[cls];
+        if (run->next)
+            run->next->prev = run;
+        ar->slabs[cls] = run;
+    }
+
+    if (run->nfree == run->nobjs && (run->prev != NULL || run->next != NULL)) {
+        if (run->prev) run->prev->next = run->next;
+        else           ar->slabs[cls] = run->next;
+        if (run->next) run->next->prev = run->prev;
+
+        run->next = ar->spare_runs;
+        ar->spare_runs = run;
+    }
+}
 
 /*
  * [segregated helper] 주어진 사이즈에 맞는 사이즈 클래스의 인덱스를 반환
@@ -101,31 +475,130 @@ static int get_list_index(size_t size) {
     return NUM_CLASSES - 1;
 }
 
+/*
+ * [tree helper] treap 안의 순서: 크기가 작은 쪽이 앞, 크기가 같으면 주소가 작은 쪽이 앞
+ */
+static int tree_less(void *a, void *b) {
+    size_t sa = GET_SIZE(HDRP(a));
+    size_t sb = GET_SIZE(HDRP(b));
+    return sa < sb || (sa == sb && (char *)a < (char *)b);
+}
+
+/*
+ * [tree helper] root 아래에 bp를 넣고 새 root를 반환
+ * 키 순서대로 내려가 잎에 붙인 뒤, 우선순위가 부모보다 크면 회전으로 끌어올린다
+ */
+static void *tree_insert(void *root, void *bp) {
+    void *child;
+
+    if (root == NULL) {
+        LEFT_P(bp) = NULL;
+        RIGHT_P(bp) = NULL;
+        return bp;
+    }
+    if (tree_less(bp, root)) {
+        child = tree_insert(LEFT_P(root), bp);
+        LEFT_P(root) = child;
+        if (TREE_PRIO(child) > TREE_PRIO(root)) {   /* 오른쪽 회전 */
+            LEFT_P(root) = RIGHT_P(child);
+            RIGHT_P(child) = root;
+            return child;
+        }
+    } else {
+        child = tree_insert(RIGHT_P(root), bp);
+        RIGHT_P(root) = child;
+        if (TREE_PRIO(child) > TREE_PRIO(root)) {   /* 왼쪽 회전 */
+            RIGHT_P(root) = LEFT_P(child);
+            LEFT_P(child) = root;
+            return child;
+        }
+    }
+    return root;
+}
+
+/*
+ * [tree helper] 두 서브트리를 합친다 (a의 모든 키 < b의 모든 키)
+ */
+static void *tree_merge(void *a, void *b) {
+    if (a == NULL) return b;
+    if (b == NULL) return a;
+    if (TREE_PRIO(a) > TREE_PRIO(b)) {
+        RIGHT_P(a) = tree_merge(RIGHT_P(a), b);
+        return a;
+    }
+    LEFT_P(b) = tree_merge(a, LEFT_P(b));
+    return b;
+}
+
+/*
+ * [tree helper] root 아래에서 bp를 빼고 새 root를 반환
+ * bp의 헤더 크기는 아직 넣을 때 그대로여야 한다 (키로 길을 찾음)
+ */
+static void *tree_remove(void *root, void *bp) {
+    if (root == bp)
+        return tree_merge(LEFT_P(bp), RIGHT_P(bp));
+    if (tree_less(bp, root))
+        LEFT_P(root) = tree_remove(LEFT_P(root), bp);
+    else
+        RIGHT_P(root) = tree_remove(RIGHT_P(root), bp);
+    return root;
+}
+
+/*
+ * [tree helper] asize 이상인 블록 중 가장 작은 것 (같은 크기면 가장 낮은 주소)
+ */
+static void *tree_best_fit(void *root, size_t asize) {
+    void *best = NULL;
+
+    while (root != NULL) {
+        if (GET_SIZE(HDRP(root)) >= asize) {
+            best = root;
+            root = LEFT_P(root);
+        } else {
+            root = RIGHT_P(root);
+        }
+    }
+    return best;
+}
+
 /*
  * [segregated helper] 주어진 블록을 크기에 맞는 segregated list의 맨 앞에 추가 (LIFO)
+ * TREE_MIN보다 큰 블록은 treap으로 보낸다
  */
-static void insert_block(void *bp) {
+static void insert_block(arena_t *ar, void *bp) {
+    if (GET_SIZE(HDRP(bp)) > TREE_MIN) {
+        ar->size_tree = tree_insert(ar->size_tree, bp);
+        return;
+    }
+
     int index = get_list_index(GET_SIZE(HDRP(bp)));
-    void *head = segregated_lists[index];
+    void *head = ar->segregated_lists[index];
 
     SET_SUCC(bp, head);
     if (head != NULL) {
         SET_PRED(head, bp);
     }
     SET_PRED(bp, NULL);
-    segregated_lists[index] = bp;
+    ar->segregated_lists[index] = bp;
 }
 
 /*
  * [segregated helper] 주어진 블록을 속해있는 segregated list에서 제거
  */
-static void remove_block(void *bp) {
+static void remove_block(arena_t *ar, void *bp) {
+    if (GET_SIZE(HDRP(bp)) > TREE_MIN) {
+        ar->size_tree = tree_remove(ar->size_tree, bp);
+        SET_PRED(bp, NULL);
+        SET_SUCC(bp, NULL);
+        return;
+    }
+
     int index = get_list_index(GET_SIZE(HDRP(bp)));
     void *prev = PRED_P(bp);
     void *next = SUCC_P(bp);
 
     if (prev) SET_SUCC(prev, next);
-    else      segregated_lists[index] = next;
+    else      ar->segregated_lists[index] = next;
 
     if (next) SET_PRED(next, prev);
 
@@ -134,7 +607,16 @@ static void remove_block(void *bp) {
     SET_SUCC(bp, NULL);
 }
 
-static int binary_case(size_t size) {
+/*
+ * [helper] 요청 payload 크기 -> 블록 크기(asize)
+ * 할당 블록은 헤더(WSIZE)만 오버헤드로 가진다.
+ */
+static size_t adjust_size(size_t size) {
+    size_t asize = DSIZE * ((size + WSIZE + (DSIZE - 1)) / DSIZE);
+    return MAX(asize, MIN_BLK_SIZE);
+}
+
+static size_t binary_case(size_t size) {
     if (size == 112) {
         return 128;
     } 
@@ -145,73 +627,263 @@ static int binary_case(size_t size) {
 }
 
 /*
- * mm_init - 힙과 segregated lists를 초기화
+ * mm_init - arena들과 segregated lists를 초기화하고 첫 세그먼트를 만든다
+ * (다른 스레드가 할당기를 쓰는 중에 호출하면 안 된다)
  */
 int mm_init(void) {
-    for (int i = 0; i < NUM_CLASSES; i++) {
-        segregated_lists[i] = NULL;
+    for (int a = 0; a < NUM_ARENAS; a++) {
+        for (int i = 0; i < NUM_CLASSES; i++) {
+            arenas[a].segregated_lists[i] = NULL;
+        }
+        arenas[a].size_tree = NULL;
+        for (int i = 0; i < SLAB_CLASSES; i++) {
+            arenas[a].slabs[i] = NULL;
+        }
+        arenas[a].spare_runs = NULL;
+        arenas[a].heap_end = NULL;
+#if MM_QUICKLIST
+        memset(arenas[a].quick, 0, sizeof(arenas[a].quick));
+        arenas[a].quick_count = 0;
+        arenas[a].quick_hits = arenas[a].quick_misses = arenas[a].quick_flushes = 0;
+#endif
+#if MM_THREADED
+        if (!arenas_ready)
+            pthread_mutex_init(&arenas[a].lock, NULL);
+#endif
     }
+#if MM_THREADED
+    if (!arenas_ready)
+        pthread_atfork(lock_arenas, unlock_arenas, unlock_arenas);
+#endif
+    heap_base_page = (uintptr_t)mem_heap_lo() >> PAGE_SHIFT;
 
-    if ((heap_listp = mem_sbrk(4 * WSIZE)) == (void *)-1)
-        return -1;
+    /* page map은 힙 한도(mem_max_heapsize)에 맞춰 잡고, 한도가 바뀌었을 때만 다시 매핑한다.
+     * 항목은 extend_heap이 새 페이지를 받을 때 채우므로 여기서 지울 필요가 없다. */
+    size_t map_len = (mem_max_heapsize() >> PAGE_SHIFT) + 1;
+    if (map_len != page_map_len) {
+        if (page_map != NULL)
+            munmap(page_map, page_map_len);
+        page_map = mmap(NULL, map_len, PROT_READ | PROT_WRITE,
+                        MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+        if (page_map == MAP_FAILED) {
+            page_map = NULL;
+            page_map_len = 0;
+            return -1;
+        }
+        page_map_len = map_len;
+    }
+#if MM_THREADED
+    arenas_ready = 1;
+    next_arena = 0;
+    __atomic_add_fetch(&arena_gen, 1, __ATOMIC_RELEASE);
 
-    PUT(heap_listp, 0);
-    PUT(heap_listp + (1 * WSIZE), PACK(DSIZE, 1));
-    PUT(heap_listp + (2 * WSIZE), PACK(DSIZE, 1));
-    PUT(heap_listp + (3 * WSIZE), PACK(0, 1));
-    heap_listp += (2 * WSIZE);
+    /* brk를 페이지 경계에 맞춰 두면 이후 세그먼트가 모두 페이지 단위가 된다 */
+    size_t pad = ROUND_PAGE((uintptr_t)mem_heap_lo()) - (uintptr_t)mem_heap_lo();
+    if (pad > 0 && mem_sbrk(pad) == (void *)-1)
+        return -1;
+#endif
 
-    if (extend_heap((CHUNKSIZE+WSIZE) / WSIZE) == NULL)
+    if (extend_heap(&arenas[0], (CHUNKSIZE+WSIZE) / WSIZE) == NULL)
         return -1;
+    heap_listp = (char *)mem_heap_lo() + (2 * WSIZE);
     return 0;
 }
 
 /*
  * extend_heap: 힙을 확장하고, 새로 생긴 가용 블록을 coalesce
+ * - brk가 이 arena의 epilogue 바로 뒤면 기존 세그먼트에 이어붙인다
+ * - 아니면(첫 확장이거나 다른 arena가 끼어들었으면) 새 세그먼트를 연다
  */
-static void *extend_heap(size_t words) {
+static void *extend_heap(arena_t *ar, size_t words) {
     char *bp;
-    size_t size;
+    size_t size, incr;
 
     size = (words % 2) ? (words + 1) * WSIZE : words * WSIZE;
-    if ((long)(bp = mem_sbrk(size)) == -1)
+#if MM_THREADED
+    /* brk가 항상 페이지 배수로 움직이므로 한 페이지는 정확히 한 arena에 속한다.
+     * 이어붙일 수 있어 보이면 세그먼트 비용 없이 요청한다. 그 사이 다른 arena가
+     * brk를 옮겼다면 새 세그먼트가 되고 블록이 SEG_OVERHEAD만큼 작아질 수 있다. */
+    if (ar->heap_end != NULL && (char *)mem_heap_hi() + 1 == ar->heap_end)
+        incr = ROUND_PAGE(size);
+    else
+        incr = ROUND_PAGE(size + SEG_OVERHEAD);
+#else
+    /* slab_run이 brk를 옮겼으면 이어붙일 수 없으니 새 세그먼트 */
+    if (ar->heap_end != NULL && (char *)mem_heap_hi() + 1 == ar->heap_end)
+        incr = size;
+    else
+        incr = size + SEG_OVERHEAD;
+#endif
+    if ((long)(bp = mem_sbrk(incr)) == -1)
         return NULL;
+    /* 새로 받은 페이지의 page map 항목을 이 arena 것으로 초기화 (이전 힙의 흔적 제거) */
+    memset(&page_map[PAGE_INDEX(bp)], (int)(ar - arenas),
+           PAGE_INDEX(bp + incr - 1) - PAGE_INDEX(bp) + 1);
 
-    PUT(HDRP(bp), PACK(size, 0));
+    if (bp == ar->heap_end) {
+        /* 새 블록의 헤더는 기존 epilogue 자리이므로 그 prev_alloc 비트를 이어받는다 */
+        size = incr;
+        PUT(HDRP(bp), PACK(size, GET_PREV_ALLOC(HDRP(bp))));
+    } else {
+        /* 새 세그먼트: 정렬 패딩 + prologue를 깔아서 앞쪽 영역과 병합되지 않게 한다 */
+        PUT(bp, 0);
+        PUT(bp + (1 * WSIZE), PACK(DSIZE, 1));
+        PUT(bp + (2 * WSIZE), PACK(DSIZE, 1));
+        bp += (4 * WSIZE);
+        size = incr - SEG_OVERHEAD;
+        PUT(HDRP(bp), PACK(size, PREV_ALLOC));
+    }
     PUT(FTRP(bp), PACK(size, 0));
     PUT(HDRP(NEXT_BLKP(bp)), PACK(0, 1));
+    ar->heap_end = NEXT_BLKP(bp);
 
-    return coalesce(bp);
+    return coalesce(ar, bp);
 }
 
 /*
- * mm_malloc - 요청 크기를 정렬/오버헤드 반영해 asize로 조정 후 할당
+ * mm_malloc - 작은 요청은 slab에서, 나머지는 asize로 조정 후 segregated lists에서 할당
  */
 void *mm_malloc(size_t size) {
+    char *bp;
+    arena_t *ar;
     size_t asize;
+
+    if (size == 0)
+        return NULL;
+    if (MM_MMAP_THRESHOLD && size >= MM_MMAP_THRESHOLD)
+        return map_alloc(size);
+    if (size > (word_t)-1 - CHUNKSIZE)      /* 헤더로는 표현할 수 없는 크기 (4바이트 헤더면 make WIDE=1) */
+        return NULL;
+
+    ar = thread_arena();
+    LOCK(ar);
+#if MM_SLAB
+    if (size <= SLAB_MAX) {
+        bp = slab_alloc(ar, size);
+        UNLOCK(ar);
+        return bp;
+    }
+#endif
+
+    asize = adjust_size(binary_case(size));
+#if MM_QUICKLIST
+    if (asize <= QUICK_MAX) {
+        bp = ar->quick[QUICK_INDEX(asize)];
+        if (bp != NULL) {
+            ar->quick[QUICK_INDEX(asize)] = QUICK_NEXT(bp);
+            PUT(HDRP(bp), GET(HDRP(bp)) & ~QUICK_TAG);
+            ar->quick_count--;
+            ar->quick_hits++;
+            UNLOCK(ar);
+            return bp;
+        }
+        ar->quick_misses++;
+    }
+#endif
+    bp = arena_malloc(ar, asize);
+    UNLOCK(ar);
+    return bp;
+}
+
+/*
+ * map_alloc - 힙 밖에 size 바이트 payload를 갖는 블록을 따로 매핑
+ */
+static void *map_alloc(size_t size) {
+    size_t len;
+    char *bp;
+
+    if (__builtin_add_overflow(size, MAP_OVERHEAD, &len))   /* SIZE_MAX 근처: 감싸지 않게 거절 */
+        return NULL;
+    if ((bp = mem_map(len)) == NULL)
+        return NULL;
+    bp += MAP_OVERHEAD;
+    PUT(HDRP(bp), PACK(0, MAPPED | 1));
+    return bp;
+}
+
+/*
+ * arena_malloc - asize 블록을 가용 리스트에서 찾고, 없으면 힙을 늘려서 할당
+ */
+static void *arena_malloc(arena_t *ar, size_t asize) {
     size_t extendsize;
     char *bp;
 
-    if (size == 0)
+    bp = find_fit(ar, asize);
+#if MM_QUICKLIST
+    /* 힙을 늘리기 전에 미뤄 둔 블록부터 병합해 본다 */
+    if (bp == NULL && ar->quick_count > 0) {
+        quick_flush(ar);
+        bp = find_fit(ar, asize);
+    }
+#endif
+    if (bp == NULL) {
+        extendsize = MAX(asize, CHUNKSIZE);
+        /* 다른 arena와 경쟁해 새 세그먼트가 열리면 블록이 모자랄 수 있다. 그땐 한 번 더 확장 */
+        while ((bp = extend_heap(ar, extendsize / WSIZE)) != NULL &&
+               GET_SIZE(HDRP(bp)) < asize)
+            ;
+    }
+    if (bp != NULL)
+        place(ar, bp, asize);
+    return bp;
+}
+
+/*
+ * alloc_aligned - payload가 align(2의 거듭제곱)에 맞는 asize 블록을 할당
+ * 여유 있게 받은 뒤 앞쪽 자투리는 가용 블록으로 떼어 내고, 뒤쪽 남는 부분은 분할한다
+ */
+static void *alloc_aligned(arena_t *ar, size_t align, size_t asize) {
+    char *bp, *abp;
+    size_t csize, lead, rem;
+
+    if ((bp = arena_malloc(ar, asize + align + MIN_BLK_SIZE)) == NULL)
         return NULL;
 
-    size = binary_case(size);
+    abp = (char *)(((uintptr_t)bp + align - 1) & ~(uintptr_t)(align - 1));
+    if (abp != bp && (size_t)(abp - bp) < MIN_BLK_SIZE)
+        abp += align;
+    lead = abp - bp;
+    csize = GET_SIZE(HDRP(bp));
 
-    if (size <= DSIZE) {
-        asize = MIN_BLK_SIZE;
-    } else {
-        asize = DSIZE * ((size + (DSIZE) + (DSIZE - 1)) / DSIZE);
+    if (lead > 0) {
+        PUT(HDRP(abp), PACK(csize - lead, 1));
+        PUT(HDRP(bp), PACK(lead, GET_PREV_ALLOC(HDRP(bp))));
+        PUT(FTRP(bp), PACK(lead, 0));
+        coalesce(ar, bp);
+        csize -= lead;
     }
 
-    if ((bp = find_fit(asize)) != NULL) {
-        place(bp, asize);
-        return bp;
+    rem = csize - asize;
+    if (rem >= MIN_BLK_SIZE) {
+        PUT(HDRP(abp), PACK(asize, GET_PREV_ALLOC(HDRP(abp)) | 1));
+        void *rbp = NEXT_BLKP(abp);
+        PUT(HDRP(rbp), PACK(rem, PREV_ALLOC));
+        PUT(FTRP(rbp), PACK(rem, 0));
+        coalesce(ar, rbp);
     }
+    return abp;
+}
 
-    extendsize = MAX(asize, CHUNKSIZE);
-    if ((bp = extend_heap(extendsize / WSIZE)) == NULL)
+/*
+ * mm_memalign - payload가 align(2의 거듭제곱)에 맞는 size 바이트 블록
+ * ALIGNMENT 이하 정렬은 mm_malloc이 이미 보장하므로 그대로 넘기고,
+ * 그보다 크면 slab/mmap을 거치지 않고 힙에서 alloc_aligned로 받는다
+ */
+void *mm_memalign(size_t align, size_t size) {
+    arena_t *ar;
+    void *bp;
+
+    if (align <= ALIGNMENT)
+        return mm_malloc(size);
+    if (size == 0 || (align & (align - 1)) != 0)
         return NULL;
-    place(bp, asize);
+    if (align > (word_t)-1 / 4 || size > (word_t)-1 / 4)  /* 헤더에 담을 수 없는 크기 */
+        return NULL;
+
+    ar = thread_arena();
+    LOCK(ar);
+    bp = alloc_aligned(ar, align, adjust_size(size));
+    UNLOCK(ar);
     return bp;
 }
 
@@ -219,49 +891,165 @@ void *mm_malloc(size_t size) {
  * mm_free: 블록을 해제하고, coalesce를 통해 가용 리스트에 다시 추가
  */
 void mm_free(void *bp) {
+    if (IS_MAPPED(bp)) {
+        mem_unmap((char *)bp - MAP_OVERHEAD);
+        return;
+    }
+
+    arena_t *ar = block_arena(bp);
+    LOCK(ar);
+    if (IS_SLAB(bp)) {
+        slab_free(ar, bp);
+    }
+#if MM_QUICKLIST
+    else if (GET_SIZE(HDRP(bp)) <= QUICK_MAX) {
+        int index = QUICK_INDEX(GET_SIZE(HDRP(bp)));
+        PUT(HDRP(bp), GET(HDRP(bp)) | QUICK_TAG);
+        QUICK_NEXT(bp) = ar->quick[index];
+        ar->quick[index] = bp;
+        if (++ar->quick_count > QUICK_LIMIT)
+            quick_flush(ar);
+    }
+#endif
+    else {
+        arena_free(ar, bp);
+    }
+    UNLOCK(ar);
+}
+
+#if MM_QUICKLIST
+/*
+ * quick_flush: 퀵 리스트에 미뤄 둔 블록을 전부 가용으로 돌리고 병합
+ */
+static void quick_flush(arena_t *ar) {
+    for (int i = 0; i < QUICK_CLASSES; i++) {
+        void *bp = ar->quick[i];
+        while (bp != NULL) {
+            void *next = QUICK_NEXT(bp);   /* arena_free가 payload를 덮어쓰기 전에 읽어 둔다 */
+            arena_free(ar, bp);
+            bp = next;
+        }
+        ar->quick[i] = NULL;
+    }
+    ar->quick_count = 0;
+    ar->quick_flushes++;
+}
+
+/*
+ * mm_print_stats: 퀵 리스트 적중률 출력 (mdriver -V가 트레이스마다 호출)
+ */
+void mm_print_stats(FILE *fp) {
+    unsigned long hits = 0, misses = 0, flushes = 0;
+
+    for (int a = 0; a < NUM_ARENAS; a++) {
+        hits += arenas[a].quick_hits;
+        misses += arenas[a].quick_misses;
+        flushes += arenas[a].quick_flushes;
+    }
+    fprintf(fp, "quick lists: %lu hits, %lu misses (%.1f%% hit rate), %lu flushes\n",
+            hits, misses, hits + misses ? 100.0 * hits / (hits + misses) : 0.0, flushes);
+}
+#endif
+
+/*
+ * arena_free: 일반 블록을 가용으로 표시하고 병합
+ */
+static void arena_free(arena_t *ar, void *bp) {
     size_t size = GET_SIZE(HDRP(bp));
-    PUT(HDRP(bp), PACK(size, 0));
+    char *lo = HDRP(bp), *hi = HDRP(bp) + size;
+    char *next = NEXT_BLKP(bp);
+
+    /* 병합될 이웃 중 RELEASE_MIN보다 작은 것은 아직 반납하지 않았으므로 범위에 넣는다 */
+    if (!GET_PREV_ALLOC(HDRP(bp)) && GET_SIZE(HDRP(bp) - WSIZE) < RELEASE_MIN)
+        lo -= GET_SIZE(HDRP(bp) - WSIZE);
+    if (!GET_ALLOC(HDRP(next)) && GET_SIZE(HDRP(next)) < RELEASE_MIN)
+        hi += GET_SIZE(HDRP(next));
+
+    PUT(HDRP(bp), PACK(size, GET_PREV_ALLOC(HDRP(bp))));
     PUT(FTRP(bp), PACK(size, 0));
-    coalesce(bp);
+    trim_block(ar, coalesce(ar, bp), lo, hi);
+}
+
+/*
+ * trim_block: 병합이 끝난 가용 블록이 크면 메모리를 시스템에 돌려준다
+ * - brk 맨 위의 wilderness면 TRIM_PAD쯤만 남기고 힙을 줄인다
+ *   (줄이는 양은 PAGE_SIZE 배수: MM_THREADED에서 한 페이지가 한 arena에만 속하도록)
+ * - 아니면 [lo, hi)를 OS 페이지 경계로 넓혀 헤더/링크/푸터를 뺀 페이지들을 반납.
+ *   [lo, hi)는 이번에 가용이 된 블록과 RELEASE_MIN보다 작았던 이웃들
+ *   (더 큰 이웃의 가운데는 이미 반납되어 있다)
+ */
+static void trim_block(arena_t *ar, void *bp, char *lo, char *hi) {
+    size_t size = GET_SIZE(HDRP(bp));
+
+    if (MM_TRIM_THRESHOLD == 0)
+        return;
+
+    if (size > MM_TRIM_THRESHOLD && NEXT_BLKP(bp) == ar->heap_end) {
+        size_t cut = (size - TRIM_PAD) & ~(size_t)(PAGE_SIZE - 1);
+        size_t keep = size - cut;
+
+        if (cut > 0 && mem_shrink(ar->heap_end, cut) == 0) {
+            remove_block(ar, bp);
+            PUT(HDRP(bp), PACK(keep, GET_PREV_ALLOC(HDRP(bp))));
+            PUT(FTRP(bp), PACK(keep, 0));
+            PUT(HDRP(NEXT_BLKP(bp)), PACK(0, 1));   /* 새 epilogue */
+            ar->heap_end = NEXT_BLKP(bp);
+            insert_block(ar, bp);
+            return;                                 /* 남긴 TRIM_PAD는 그대로 둔다 */
+        }
+    }
+    if (size < RELEASE_MIN)
+        return;
+    /* [lo, hi) 양끝에 걸친 OS 페이지도 이제 전부 가용일 수 있으므로 페이지 경계까지 넓힌다 */
+    size_t os_page = mem_pagesize();
+    lo = (char *)((uintptr_t)lo & ~(os_page - 1));
+    hi = (char *)(((uintptr_t)hi + os_page - 1) & ~(os_page - 1));
+    lo = MAX(lo, (char *)bp + 2 * PTRSIZE);
+    hi = MIN(hi, FTRP(bp));
+    if (hi > lo)
+        mem_release(lo, hi - lo);
 }
 
 /*
  * coalesce: 주변 블록과 병합하고, 최종 가용 블록을 리스트에 추가 (개선된 버전)
+ * - 이전 블록 상태는 내 헤더의 prev_alloc 비트로 확인 (할당 블록엔 푸터가 없음)
+ * - 병합 후 다음 블록 헤더의 prev_alloc 비트를 내려서 "앞이 가용"임을 알린다
  */
-static void *coalesce(void *bp)
+static void *coalesce(arena_t *ar, void *bp)
 {
-    size_t prev_alloc = GET_ALLOC(FTRP(PREV_BLKP(bp)));
+    size_t prev_alloc = GET_PREV_ALLOC(HDRP(bp));
     size_t next_alloc = GET_ALLOC(HDRP(NEXT_BLKP(bp)));
     size_t size = GET_SIZE(HDRP(bp));
 
     if (prev_alloc && !next_alloc) {           /* Case 2: 다음 블록과 병합 */
         void *next_bp = NEXT_BLKP(bp);
-        remove_block(next_bp);
+        remove_block(ar, next_bp);
         size += GET_SIZE(HDRP(next_bp));
-        PUT(HDRP(bp), PACK(size, 0));
+        PUT(HDRP(bp), PACK(size, PREV_ALLOC));
         PUT(FTRP(bp), PACK(size, 0));
     }
     else if (!prev_alloc && next_alloc) {      /* Case 3: 이전 블록과 병합 */
         void *prev_bp = PREV_BLKP(bp);
-        remove_block(prev_bp);
+        remove_block(ar, prev_bp);
         size += GET_SIZE(HDRP(prev_bp));
         bp = prev_bp;
-        PUT(HDRP(bp), PACK(size, 0));
+        PUT(HDRP(bp), PACK(size, GET_PREV_ALLOC(HDRP(bp))));
         PUT(FTRP(bp), PACK(size, 0));
     }
     else if (!prev_alloc && !next_alloc) {     /* Case 4: 양쪽 블록과 병합 */
         void *prev_bp = PREV_BLKP(bp);
         void *next_bp = NEXT_BLKP(bp);
-        remove_block(prev_bp);
-        remove_block(next_bp);
+        remove_block(ar, prev_bp);
+        remove_block(ar, next_bp);
         size += GET_SIZE(HDRP(prev_bp)) + GET_SIZE(HDRP(next_bp));
         bp = prev_bp;
-        PUT(HDRP(bp), PACK(size, 0));
+        PUT(HDRP(bp), PACK(size, GET_PREV_ALLOC(HDRP(bp))));
         PUT(FTRP(bp), PACK(size, 0));
     }
     /* Case 1: 아무것도 안 함 */
 
-    insert_block(bp);
+    CLR_PREV_ALLOC(HDRP(NEXT_BLKP(bp)));
+    insert_block(ar, bp);
     return bp;
 }
 
@@ -269,14 +1057,18 @@ static void *coalesce(void *bp)
  * find_fit: Segregated list 전체에서 asize 이상 중 "가장 근접한" 블록 선택 (Global Best-Fit)
  * - 요청 bin부터 시작해 상위 bin까지 전역 탐색
  * - coalescing 패턴에서 방금 병합된 "딱 맞는" 블록을 놓치지 않게 함
+ * - 리스트에 맞는 블록이 없으면 treap에서 O(log n) best-fit (treap 블록은 리스트 블록보다 항상 큼)
  */
-static void *find_fit(size_t asize) {
+static void *find_fit(arena_t *ar, size_t asize) {
     void *best = NULL;
     size_t best_sz = (size_t)-1;
 
+    if (asize > TREE_MIN)
+        return tree_best_fit(ar->size_tree, asize);
+
     int start = get_list_index(asize);
     for (int i = start; i < NUM_CLASSES; i++) {
-        for (void *bp = segregated_lists[i]; bp != NULL; bp = SUCC_P(bp)) {
+        for (void *bp = ar->segregated_lists[i]; bp != NULL; bp = SUCC_P(bp)) {
             size_t sz = GET_SIZE(HDRP(bp));
             if (sz >= asize && sz < best_sz) {
                 best = bp;
@@ -285,32 +1077,34 @@ static void *find_fit(size_t asize) {
             }
         }
     }
+    if (best == NULL)
+        best = tree_best_fit(ar->size_tree, asize);
     return best;
 }
 
 /*
  * place: 찾은 가용 블록에 요청한 크기만큼 할당하고, 남는 부분은 분할 (수정된 버전)
  */
-static void place(void *bp, size_t asize) {
+static void place(arena_t *ar, void *bp, size_t asize) {
     size_t csize = GET_SIZE(HDRP(bp));
-    remove_block(bp);
+    size_t prev_alloc = GET_PREV_ALLOC(HDRP(bp));
+    remove_block(ar, bp);
 
     size_t rem = csize - asize;
 
     if (rem >= MIN_BLK_SIZE) {
-        PUT(HDRP(bp), PACK(asize, 1));
-        PUT(FTRP(bp), PACK(asize, 1));
+        PUT(HDRP(bp), PACK(asize, prev_alloc | 1));
         
         void *rbp = NEXT_BLKP(bp);
-        PUT(HDRP(rbp), PACK(rem, 0));
+        PUT(HDRP(rbp), PACK(rem, PREV_ALLOC));
         PUT(FTRP(rbp), PACK(rem, 0));
         
         // insert_block 대신 coalesce를 호출하여, rbp 바로 다음 블록이
         // 가용 상태일 경우 즉시 병합하도록 함.
-        coalesce(rbp);
+        coalesce(ar, rbp);
     } else {
-        PUT(HDRP(bp), PACK(csize, 1));
-        PUT(FTRP(bp), PACK(csize, 1));
+        PUT(HDRP(bp), PACK(csize, prev_alloc | 1));
+        SET_PREV_ALLOC(HDRP(NEXT_BLKP(bp)));
     }
 }
 
@@ -329,58 +1123,102 @@ void *mm_realloc(void *bp, size_t size)
         mm_free(bp);
         return NULL;
     }
+    if (size > (word_t)-1 - CHUNKSIZE)      /* adjust_size가 넘치는 크기: 원래 블록은 그대로 */
+        return NULL;
 
-    size_t new_asize;
-    if (size <= DSIZE) {
-        new_asize = MIN_BLK_SIZE;
-    } else {
-        new_asize = DSIZE * ((size + (DSIZE) + (DSIZE - 1)) / DSIZE);
+    /* 매핑 블록: 계속 크면 mem_remap으로 늘리거나 줄이고, 작아지면 힙으로 옮긴다 */
+    if (IS_MAPPED(bp)) {
+        if (MM_MMAP_THRESHOLD && size >= MM_MMAP_THRESHOLD) {
+            size_t len;
+            if (size <= MAP_SIZE(bp) && MAP_SIZE(bp) - size < CHUNKSIZE)
+                return bp;      /* 페이지 반올림 여유 안이면 그대로 */
+            if (__builtin_add_overflow(size, MAP_OVERHEAD, &len))
+                return NULL;
+            char *new_bp = mem_remap((char *)bp - MAP_OVERHEAD, len);
+            if (new_bp == NULL)
+                return NULL;
+            return new_bp + MAP_OVERHEAD;
+        }
+        void *new_bp = mm_malloc(size);
+        if (new_bp == NULL)
+            return NULL;
+        memcpy(new_bp, bp, size);
+        mem_unmap((char *)bp - MAP_OVERHEAD);
+        return new_bp;
     }
 
+    /* slab object: 클래스 크기 안이면 그대로, 아니면 옮긴다 */
+    if (IS_SLAB(bp)) {
+        size_t osize = SLAB_OF(bp)->size;
+        if (size <= osize)
+            return bp;
+        void *new_bp = mm_malloc(size);
+        if (new_bp == NULL)
+            return NULL;
+        memcpy(new_bp, bp, osize);
+        mm_free(bp);
+        return new_bp;
+    }
+
+    arena_t *ar = block_arena(bp);
+    LOCK(ar);
+
+    size_t new_asize = adjust_size(size);
     size_t old_csize = GET_SIZE(HDRP(bp));
+    size_t prev_alloc = GET_PREV_ALLOC(HDRP(bp));
 
     /* [축소] 요청 크기가 더 작거나 같을 경우 */
     if (new_asize <= old_csize) {
         size_t rem = old_csize - new_asize;
         if (rem >= MIN_BLK_SIZE) {
-            PUT(HDRP(bp), PACK(new_asize, 1));
-            PUT(FTRP(bp), PACK(new_asize, 1));
+            PUT(HDRP(bp), PACK(new_asize, prev_alloc | 1));
             void *rbp = NEXT_BLKP(bp);
-            PUT(HDRP(rbp), PACK(rem, 0));
+            PUT(HDRP(rbp), PACK(rem, PREV_ALLOC));
             PUT(FTRP(rbp), PACK(rem, 0));
-            coalesce(rbp);
+            coalesce(ar, rbp);
         }
+        UNLOCK(ar);
         return bp;
     }
 
+#if MM_QUICKLIST
+    /* 바로 뒤 블록이 퀵 리스트에 묶여 있으면, 늘리기 전에 풀어서 병합해 둔다 */
+    if (GET(HDRP(NEXT_BLKP(bp))) & QUICK_TAG)
+        quick_flush(ar);
+#endif
+
     /* [확장] 바로 다음 블록이 가용하고, 합친 크기가 충분한 경우 (In-place 최적화) */
     void *next_bp = NEXT_BLKP(bp);
     if (!GET_ALLOC(HDRP(next_bp)) && (old_csize + GET_SIZE(HDRP(next_bp))) >= new_asize) {
         size_t total_size = old_csize + GET_SIZE(HDRP(next_bp));
-        remove_block(next_bp);
+        remove_block(ar, next_bp);
         
         size_t rem = total_size - new_asize;
         if (rem >= MIN_BLK_SIZE) {
-            PUT(HDRP(bp), PACK(new_asize, 1));
-            PUT(FTRP(bp), PACK(new_asize, 1));
+            PUT(HDRP(bp), PACK(new_asize, prev_alloc | 1));
             void* rbp = NEXT_BLKP(bp);
-            PUT(HDRP(rbp), PACK(rem, 0));
+            PUT(HDRP(rbp), PACK(rem, PREV_ALLOC));
             PUT(FTRP(rbp), PACK(rem, 0));
-            insert_block(rbp);
+            insert_block(ar, rbp);
         } else {
-            PUT(HDRP(bp), PACK(total_size, 1));
-            PUT(FTRP(bp), PACK(total_size, 1));
+            PUT(HDRP(bp), PACK(total_size, prev_alloc | 1));
+            SET_PREV_ALLOC(HDRP(NEXT_BLKP(bp)));
         }
+        UNLOCK(ar);
         return bp;
     }
+    UNLOCK(ar);
 
     /* --- 여기가 바로 새로운 전략이 적용되는 부분 --- */
     /* [최후의 수단] 새로 할당 후 복사 ('과잉 투자' 적용) */
     
     // 요청받은 크기보다 더 넉넉하게 (예: 2배) 공간을 요청한다.
     size_t new_alloc_size = MAX(new_asize, old_csize * 10);
+    // 매핑 블록이 될 크기라면 앞으로는 mem_remap으로 늘어나므로 미리 더 받아 둘 필요가 없다.
+    if (MM_MMAP_THRESHOLD && new_alloc_size - WSIZE >= MM_MMAP_THRESHOLD)
+        new_alloc_size = new_asize;
 
-    void *new_bp = mm_malloc(new_alloc_size - DSIZE); // mm_malloc은 페이로드 크기를 인자로 받으므로 DSIZE를 빼준다.
+    void *new_bp = mm_malloc(new_alloc_size - WSIZE); // mm_malloc은 페이로드 크기를 인자로 받으므로 헤더(WSIZE)를 빼준다.
     if (new_bp == NULL) {
         // 만약 너무 큰 공간 요청이 실패하면, 원래 요청했던 크기로 다시 시도한다.
         if ((new_bp = mm_malloc(size)) == NULL) {
@@ -389,8 +1227,149 @@ void *mm_realloc(void *bp, size_t size)
     }
     
     // payload 크기만큼만 복사
-    size_t copySize = old_csize - DSIZE;
+    size_t copySize = old_csize - WSIZE;
     memcpy(new_bp, bp, copySize);
-    mm_free(bp);
+
+    /* 옮기고 남은 자리는 같은 크기로 다시 쓰일 일이 드무니 퀵 리스트를 거치지 않고 바로 병합 */
+    LOCK(ar);
+    arena_free(ar, bp);
+    UNLOCK(ar);
     return new_bp;
-}
\ No newline at end of file
+}
+
+/*
+ * mm_calloc - nmemb * size 바이트를 0으로 채워서 할당
+ * 매핑 블록은 새로 받은 페이지라 이미 0이므로 건드리지 않는다 (RSS를 늘리지 않음)
+ */
+void *mm_calloc(size_t nmemb, size_t size) {
+    size_t bytes;
+    void *bp;
+
+    if (__builtin_mul_overflow(nmemb, size, &bytes))
+        return NULL;
+    if ((bp = mm_malloc(bytes)) != NULL && !IS_MAPPED(bp))
+        memset(bp, 0, bytes);
+    return bp;
+}
+
+/*
+ * mm_usable_size - 할당된 블록에 실제로 쓸 수 있는 payload 바이트 수
+ */
+size_t mm_usable_size(void *bp) {
+    if (bp == NULL)
+        return 0;
+    if (IS_MAPPED(bp))
+        return MAP_SIZE(bp);
+    if (IS_SLAB(bp))
+        return SLAB_OF(bp)->size;
+    return GET_SIZE(HDRP(bp)) - WSIZE;
+}
+
+/*
+ * [class helper] 크기 클래스 번호 -> 이름 (mm_size_class, mm_free_space가 쓴다)
+ * list 이름의 숫자는 그 리스트의 최대 블록 크기.
+ */
+static void class_name(int cls, char *name, size_t len) {
+    if (cls < SLAB_CLASSES)
+        snprintf(name, len, "slab-%d", (cls + 1) * DSIZE);
+    else if (cls < SLAB_CLASSES + NUM_CLASSES)
+        snprintf(name, len, "list-%zu", (size_t)MIN_BLK_SIZE << (cls - SLAB_CLASSES));
+    else if (cls == SLAB_CLASSES + NUM_CLASSES)
+        snprintf(name, len, "tree");
+    else
+        snprintf(name, len, "mmap");
+}
+
+/*
+ * mm_size_class - 요청 size를 처리하는 크기 클래스의 번호와 이름 (tracestat이 쓴다)
+ * mm_malloc과 같은 순서로 고른다: slab 클래스, segregated list, treap, mmap.
+ * 번호는 작은 요청의 클래스일수록 작다.
+ */
+int mm_size_class(size_t size, char *name, size_t len) {
+    size_t asize;
+    int cls;
+
+    if (MM_MMAP_THRESHOLD && size >= MM_MMAP_THRESHOLD)
+        cls = SLAB_CLASSES + NUM_CLASSES + 1;
+    else if (MM_SLAB && size <= SLAB_MAX)
+        cls = size ? (int)((size + DSIZE - 1) / DSIZE) - 1 : 0;
+    else if ((asize = adjust_size(binary_case(size))) > TREE_MIN)
+        cls = SLAB_CLASSES + NUM_CLASSES;
+    else
+        cls = SLAB_CLASSES + get_list_index(asize);
+    class_name(cls, name, len);
+    return cls;
+}
+
+/*
+ * [class helper] 가용 블록 하나를 그 클래스(list 또는 tree)의 합계에 더한다
+ */
+static void count_free(size_t *bytes, size_t *largest, size_t size) {
+    int cls = size > TREE_MIN ? SLAB_CLASSES + NUM_CLASSES
+                              : SLAB_CLASSES + get_list_index(size);
+
+    bytes[cls] += size;
+    largest[cls] = MAX(largest[cls], size);
+}
+
+/*
+ * [class helper] treap의 모든 가용 블록을 센다 (treap 깊이는 기대값 O(log n))
+ */
+static void count_tree(void *root, size_t *bytes, size_t *largest) {
+    if (root == NULL)
+        return;
+    count_free(bytes, largest, GET_SIZE(HDRP(root)));
+    count_tree(LEFT_P(root), bytes, largest);
+    count_tree(RIGHT_P(root), bytes, largest);
+}
+
+/*
+ * mm_free_space - 지금 가용인 바이트와 가장 큰 가용 블록을 크기 클래스별로 visit에 넘긴다
+ * (mdriver --timeline이 샘플마다 호출). 번호와 이름은 mm_size_class와 같고,
+ * 힙 안의 클래스(slab, list, tree)는 비어 있어도 매번 같은 순서로 넘긴다.
+ * slab run의 빈 칸과 퀵 리스트에 미뤄 둔 블록도 가용으로 센다. 크기는 헤더/푸터를 포함한 블록 크기.
+ * 마지막으로 어느 클래스에도 속하지 않은 spare slab run을 클래스 -1로 넘긴다.
+ */
+void mm_free_space(void (*visit)(int cls, const char *name, size_t bytes,
+                                 size_t largest, void *arg), void *arg) {
+    size_t bytes[SLAB_CLASSES + NUM_CLASSES + 1] = {0};
+    size_t largest[SLAB_CLASSES + NUM_CLASSES + 1] = {0};
+    size_t spare = 0;
+    char name[16];
+
+#if MM_THREADED
+    lock_arenas();
+#endif
+    for (int a = 0; a < NUM_ARENAS; a++) {
+        arena_t *ar = &arenas[a];
+
+        for (int c = 0; c < SLAB_CLASSES; c++) {
+            for (slab_t *run = ar->slabs[c]; run != NULL; run = run->next) {
+                bytes[c] += (size_t)run->nfree * run->size;
+                largest[c] = run->size;
+            }
+        }
+        for (int i = 0; i < NUM_CLASSES; i++) {
+            for (void *bp = ar->segregated_lists[i]; bp != NULL; bp = SUCC_P(bp))
+                count_free(bytes, largest, GET_SIZE(HDRP(bp)));
+        }
+        count_tree(ar->size_tree, bytes, largest);
+        for (slab_t *run = ar->spare_runs; run != NULL; run = run->next)
+            spare += SLAB_RUN_BYTES;
+#if MM_QUICKLIST
+        for (int i = 0; i < QUICK_CLASSES; i++) {
+            for (void *bp = ar->quick[i]; bp != NULL; bp = QUICK_NEXT(bp))
+                count_free(bytes, largest, GET_SIZE(HDRP(bp)));
+        }
+#endif
+    }
+#if MM_THREADED
+    unlock_arenas();
+#endif
+
+    for (int c = 0; c <= SLAB_CLASSES + NUM_CLASSES; c++) {
+        class_name(c, name, sizeof(name));
+        visit(c, name, bytes[c], largest[c], arg);
+    }
+    visit(-1, "slab-spare", spare, spare ? SLAB_RUN_BYTES : 0, arg);
+}
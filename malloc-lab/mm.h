@@ -5,6 +5,48 @@ extern void *mm_malloc (size_t size);
 extern void mm_free (void *ptr);
 extern void *mm_realloc(void *ptr, size_t size);
 
+/*
+ * The rest of the C allocation interface, for the LD_PRELOAD library
+ * (preload.c). The driver doesn't call these, so other packages need
+ * not define them.
+ */
+extern void *mm_memalign(size_t align, size_t size);
+extern void *mm_calloc(size_t nmemb, size_t size);
+extern size_t mm_usable_size(void *ptr);
+
+/*
+ * Optional: a package that keeps internal counters may define this.
+ * The driver prints it after each trace with -V. It is weak so that
+ * packages without it still link.
+ */
+extern void mm_print_stats(FILE *fp) __attribute__((weak));
+
+/*
+ * Optional: nonzero if the package may be called from several threads
+ * at once. mdriver -T refuses a package that doesn't declare it. Weak
+ * as above.
+ */
+extern const int mm_thread_safe __attribute__((weak));
+
+/*
+ * Optional: the number and name of the size class that serves a
+ * request of size bytes; smaller requests get smaller numbers.
+ * tracestat maps request sizes onto these classes. Weak as above.
+ */
+extern int mm_size_class(size_t size, char *name, size_t len) __attribute__((weak));
+
+/*
+ * Optional: what is free in the heap right now. Calls visit once per
+ * size class of mm_size_class that lives in the heap, in order and
+ * even when it is empty, with the bytes of its free blocks and the
+ * size of the largest one; class -1 may follow for free memory that
+ * no class holds yet. mdriver --timeline samples it during a replay.
+ * Weak as above.
+ */
+extern void mm_free_space(void (*visit)(int cls, const char *name, size_t bytes,
+                                        size_t largest, void *arg),
+                          void *arg) __attribute__((weak));
+
 
 /* 
  * Students work in teams of one or two.  Teams enter their team name, 
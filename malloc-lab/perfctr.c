@@ -0,0 +1,142 @@
+/*
+ * perfctr.c - Hardware performance counters for the malloc lab driver
+ *
+ * See perfctr.h. The counters follow the calling thread only and count
+ * user-mode events only, which perf_event_paranoid levels up to 2
+ * allow. When the kernel has to share the PMU between more events
+ * than it has counters, each count is scaled up by the fraction of the
+ * time its event was actually counting.
+ */
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+
+#include "perfctr.h"
+
+/* An L1d/dTLB read-miss event of the generic cache event type */
+#define CACHE_READ_MISS(cache) \
+	((cache) | (PERF_COUNT_HW_CACHE_OP_READ << 8) | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16))
+
+/* How each counted event is asked for */
+static const struct
+{
+	const char *name;
+	uint32_t type;
+	uint64_t config;
+} events[PC_EVENTS] = {
+	[PC_CYCLES] = {"cyc", PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES},
+	[PC_INSTRUCTIONS] = {"ins", PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS},
+	[PC_L1D_MISSES] = {"L1d", PERF_TYPE_HW_CACHE, CACHE_READ_MISS(PERF_COUNT_HW_CACHE_L1D)},
+	[PC_LLC_MISSES] = {"LLC", PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES},
+	[PC_DTLB_MISSES] = {"dTLB", PERF_TYPE_HW_CACHE, CACHE_READ_MISS(PERF_COUNT_HW_CACHE_DTLB)},
+	[PC_BRANCH_MISSES] = {"br", PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES},
+};
+
+static int fds[PC_EVENTS] = {-1, -1, -1, -1, -1, -1};
+static int open_errno; /* why the first event that failed to open failed */
+
+/*
+ * perfctr_open - Open a counter for every event the machine has.
+ *     Returns how many were opened; if none, perfctr_error says why.
+ */
+int perfctr_open(void)
+{
+	struct perf_event_attr attr;
+	int i, n = 0;
+
+	for (i = 0; i < PC_EVENTS; i++)
+	{
+		memset(&attr, 0, sizeof(attr));
+		attr.size = sizeof(attr);
+		attr.type = events[i].type;
+		attr.config = events[i].config;
+		attr.disabled = 1;
+		attr.exclude_kernel = 1;
+		attr.exclude_hv = 1;
+		attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+		fds[i] = syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+		if (fds[i] >= 0)
+			n++;
+		else if (open_errno == 0)
+			open_errno = errno;
+	}
+	return n;
+}
+
+/*
+ * perfctr_close - Close the counters
+ */
+void perfctr_close(void)
+{
+	int i;
+
+	for (i = 0; i < PC_EVENTS; i++)
+	{
+		if (fds[i] >= 0)
+			close(fds[i]);
+		fds[i] = -1;
+	}
+}
+
+/*
+ * perfctr_start - Zero the counters and start counting
+ */
+void perfctr_start(void)
+{
+	int i;
+
+	for (i = 0; i < PC_EVENTS; i++)
+	{
+		if (fds[i] < 0)
+			continue;
+		ioctl(fds[i], PERF_EVENT_IOC_RESET, 0);
+		ioctl(fds[i], PERF_EVENT_IOC_ENABLE, 0);
+	}
+}
+
+/*
+ * perfctr_stop - Stop counting and store the count of every event, or
+ *     -1 for an event that could not be opened or never got a counter
+ */
+void perfctr_stop(double counts[PC_EVENTS])
+{
+	uint64_t buf[3]; /* value, time enabled, time running */
+	int i;
+
+	for (i = 0; i < PC_EVENTS; i++)
+		if (fds[i] >= 0)
+			ioctl(fds[i], PERF_EVENT_IOC_DISABLE, 0);
+	for (i = 0; i < PC_EVENTS; i++)
+	{
+		counts[i] = -1;
+		if (fds[i] < 0 || read(fds[i], buf, sizeof(buf)) != sizeof(buf) || buf[2] == 0)
+			continue;
+		counts[i] = (double)buf[0] * ((double)buf[1] / (double)buf[2]);
+	}
+}
+
+/*
+ * perfctr_name - Short name of an event, for column headings
+ */
+const char *perfctr_name(int event)
+{
+	return events[event].name;
+}
+
+/*
+ * perfctr_error - Why counters could not be opened
+ */
+const char *perfctr_error(void)
+{
+	if (open_errno == ENOENT || open_errno == EOPNOTSUPP)
+		return "the CPU or hypervisor exposes no hardware counters";
+	if (open_errno == EACCES || open_errno == EPERM)
+		return "not permitted (see /proc/sys/kernel/perf_event_paranoid)";
+	if (open_errno == ENOSYS)
+		return "the kernel has no perf_event_open";
+	return strerror(open_errno);
+}
@@ -0,0 +1,32 @@
+/*
+ * perfctr.h - Hardware performance counters for the malloc lab driver
+ *
+ * With -C the driver counts CPU events over one extra replay of each
+ * trace, after the timed ones, and reports them per request. Each
+ * event is opened on its own, so a CPU or hypervisor that lacks some
+ * of them still reports the rest; if none can be opened the driver
+ * says why and carries on without them.
+ */
+#ifndef __PERFCTR_H_
+#define __PERFCTR_H_
+
+/* The counted events */
+enum
+{
+	PC_CYCLES,		 /* CPU cycles */
+	PC_INSTRUCTIONS, /* instructions retired */
+	PC_L1D_MISSES,	 /* L1 data cache read misses */
+	PC_LLC_MISSES,	 /* last level cache misses */
+	PC_DTLB_MISSES,	 /* data TLB read misses */
+	PC_BRANCH_MISSES, /* mispredicted branches */
+	PC_EVENTS
+};
+
+int perfctr_open(void);
+void perfctr_close(void);
+void perfctr_start(void);
+void perfctr_stop(double counts[PC_EVENTS]);
+const char *perfctr_name(int event);
+const char *perfctr_error(void);
+
+#endif /* __PERFCTR_H_ */
@@ -0,0 +1,232 @@
+/*
+ * preload.c - LD_PRELOAD library that runs a real program on mm.c
+ *
+ * usage: LD_PRELOAD=./libmm.so [MM_HEAP_LIMIT=64G] [MM_HUGEPAGES=1] <program>
+ *
+ * malloc, free, realloc, calloc, posix_memalign, memalign,
+ * aligned_alloc, valloc, pvalloc and malloc_usable_size are served by
+ * mm.c, built thread-safe with 16-byte alignment (the C library's
+ * guarantee on x86-64). The heap is memlib's reserved range, committed
+ * as it grows; MM_HEAP_LIMIT sets its size (default HEAP_LIMIT, with an
+ * optional K, M or G suffix) and MM_HUGEPAGES=1 backs it with
+ * transparent huge pages. MM_RELEASE_PAD sets how much stays resident
+ * above the heap top when the heap shrinks (default MEM_RELEASE_PAD).
+ * Large blocks are mapped outside it as usual.
+ *
+ * The allocator is set up by the first call, from whichever thread
+ * makes it. Pointers that did not come from this library must not be
+ * passed to free or realloc; since the library is loaded before the C
+ * library, every allocation the program makes goes through it.
+ */
+#define _GNU_SOURCE
+#include <errno.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "mm.h"
+#include "memlib.h"
+
+#define HEAP_LIMIT (64UL << 30) /* default heap reservation */
+#define MAX_REQUEST PTRDIFF_MAX /* largest size served, as in the C library */
+
+/* Only the allocation routines are visible outside the library */
+#define EXPORT __attribute__((visibility("default")))
+
+static pthread_once_t init_once = PTHREAD_ONCE_INIT;
+
+static void init(void);
+static size_t parse_size(const char *s);
+
+/*
+ * init - Reserve the heap and initialize mm.c. Nothing here may call
+ *     malloc: the first malloc of the program is waiting on it.
+ */
+static void init(void)
+{
+	const char *s;
+	static const char msg[] = "libmm.so: mm_init failed\n";
+
+	mem_set_limit(HEAP_LIMIT);
+	if ((s = getenv("MM_HEAP_LIMIT")) != NULL && parse_size(s) > 0)
+		mem_set_limit(parse_size(s));
+	if ((s = getenv("MM_RELEASE_PAD")) != NULL && (s[0] == '0' || parse_size(s) > 0))
+		mem_set_release_pad(parse_size(s));
+	if ((s = getenv("MM_HUGEPAGES")) != NULL && s[0] == '1')
+		mem_set_hugepages(1);
+	mem_init();
+	if (mm_init() < 0)
+	{
+		write(STDERR_FILENO, msg, sizeof(msg) - 1);
+		abort();
+	}
+}
+
+/*
+ * parse_size - Parse a byte count with an optional K, M or G suffix.
+ *     Returns 0 if s is not one.
+ */
+static size_t parse_size(const char *s)
+{
+	char *end;
+	size_t n = strtoul(s, &end, 10);
+
+	switch (*end)
+	{
+	case 'k':
+	case 'K':
+		n <<= 10;
+		end++;
+		break;
+	case 'm':
+	case 'M':
+		n <<= 20;
+		end++;
+		break;
+	case 'g':
+	case 'G':
+		n <<= 30;
+		end++;
+		break;
+	}
+	return (end == s || *end != '\0') ? 0 : n;
+}
+
+/**********************
+ * The exported routines
+ **********************/
+
+/*
+ * malloc - mm_malloc returns NULL for 0 bytes; the C library returns a
+ *     block that can be freed, and programs rely on it. Sizes above
+ *     MAX_REQUEST fail here, before mm.c adds its header and rounding.
+ */
+EXPORT void *malloc(size_t size)
+{
+	void *p;
+
+	pthread_once(&init_once, init);
+	if (size > MAX_REQUEST)
+	{
+		errno = ENOMEM;
+		return NULL;
+	}
+	if ((p = mm_malloc(size ? size : 1)) == NULL)
+		errno = ENOMEM;
+	return p;
+}
+
+EXPORT void free(void *ptr)
+{
+	if (ptr != NULL)
+		mm_free(ptr);
+}
+
+EXPORT void *realloc(void *ptr, size_t size)
+{
+	void *p;
+
+	if (ptr == NULL)
+		return malloc(size);
+	if (size == 0)
+	{
+		mm_free(ptr);
+		return NULL;
+	}
+	if (size > MAX_REQUEST)
+	{
+		errno = ENOMEM;
+		return NULL;
+	}
+	if ((p = mm_realloc(ptr, size)) == NULL)
+		errno = ENOMEM;
+	return p;
+}
+
+EXPORT void *calloc(size_t nmemb, size_t size)
+{
+	void *p;
+
+	pthread_once(&init_once, init);
+	if (nmemb == 0 || size == 0)
+		nmemb = size = 1;
+	if (size > MAX_REQUEST / nmemb)
+	{
+		errno = ENOMEM;
+		return NULL;
+	}
+	if ((p = mm_calloc(nmemb, size)) == NULL)
+		errno = ENOMEM;
+	return p;
+}
+
+/*
+ * memalign - Like the C library's, rounds an alignment that is not a
+ *     power of two up to one
+ */
+EXPORT void *memalign(size_t alignment, size_t size)
+{
+	void *p;
+
+	pthread_once(&init_once, init);
+	if (alignment > ((size_t)-1 >> 1) + 1)
+	{
+		errno = EINVAL;
+		return NULL;
+	}
+	if (size > MAX_REQUEST)
+	{
+		errno = ENOMEM;
+		return NULL;
+	}
+	while ((alignment & (alignment - 1)) != 0)
+		alignment = (alignment | (alignment - 1)) + 1;
+	if ((p = mm_memalign(alignment, size ? size : 1)) == NULL)
+		errno = ENOMEM;
+	return p;
+}
+
+EXPORT int posix_memalign(void **memptr, size_t alignment, size_t size)
+{
+	void *p;
+
+	if (alignment < sizeof(void *) || (alignment & (alignment - 1)) != 0)
+		return EINVAL;
+	if ((p = memalign(alignment, size)) == NULL)
+		return ENOMEM;
+	*memptr = p;
+	return 0;
+}
+
+EXPORT void *aligned_alloc(size_t alignment, size_t size)
+{
+	return memalign(alignment, size);
+}
+
+EXPORT void *valloc(size_t size)
+{
+	return memalign(mem_pagesize(), size);
+}
+
+/*
+ * pvalloc - valloc with size rounded up to whole pages; a size within
+ *     a page of SIZE_MAX would round to 0
+ */
+EXPORT void *pvalloc(size_t size)
+{
+	size_t pagesize = mem_pagesize();
+
+	if (__builtin_add_overflow(size, pagesize - 1, &size))
+	{
+		errno = ENOMEM;
+		return NULL;
+	}
+	return memalign(pagesize, size & ~(pagesize - 1));
+}
+
+EXPORT size_t malloc_usable_size(void *ptr)
+{
+	return mm_usable_size(ptr);
+}
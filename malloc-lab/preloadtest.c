@@ -0,0 +1,182 @@
+/*
+ * preloadtest.c - Check that libmm.so refuses sizes it cannot serve,
+ *     and gives freed memory back
+ *
+ * usage: LD_PRELOAD=./libmm.so ./preloadtest   (or: make preload-test)
+ *
+ * Asks every exported routine for sizes at and near SIZE_MAX, which
+ * overflow a header or a page round-up if they reach mm.c unchecked.
+ * Each must fail with ENOMEM (posix_memalign by returning it), and a
+ * failed realloc must leave the old block as it was.
+ *
+ * Then fills RSS_BYTES with small blocks and frees them, first all but
+ * the last (so the free space is inside the heap and must be released
+ * page by page) and then that one too (so the heap can shrink). After
+ * each step the resident set must be back within RSS_SLACK of where it
+ * started. Prints the checks that fail and exits with status 1 if there
+ * are any.
+ */
+#define _GNU_SOURCE
+#include <errno.h>
+#include <malloc.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+/* volatile, so the compiler neither warns about nor folds the calls */
+static volatile size_t huge[] = {
+	SIZE_MAX, SIZE_MAX - 1, SIZE_MAX - 4096, SIZE_MAX - 65536,
+	(size_t)PTRDIFF_MAX + 1, (size_t)1 << 62};
+#define NHUGE (sizeof(huge) / sizeof(huge[0]))
+
+#define RSS_BYTES (256UL << 20) /* allocated and freed by the RSS checks */
+#define RSS_BLOCK 1024			/* in blocks of this size */
+#define RSS_SLACK (16UL << 20)	/* allowed to stay resident afterwards */
+
+static int failures;
+
+/*
+ * check - Count and report a check that did not hold
+ */
+static void check(int ok, const char *what, size_t size)
+{
+	if (!ok)
+	{
+		printf("FAIL: %s (size %#zx)\n", what, size);
+		failures++;
+	}
+}
+
+/*
+ * rss - Resident set size of this process in bytes
+ */
+static size_t rss(void)
+{
+	size_t pages = 0, resident = 0;
+	FILE *fp = fopen("/proc/self/statm", "r");
+
+	if (fp != NULL)
+	{
+		if (fscanf(fp, "%zu %zu", &pages, &resident) != 2)
+			resident = 0;
+		fclose(fp);
+	}
+	return resident * sysconf(_SC_PAGESIZE);
+}
+
+/*
+ * check_rss - Fill RSS_BYTES with blocks, free them in two steps, and
+ *     check that the resident set drops back after each
+ */
+static void check_rss(void)
+{
+	size_t n = RSS_BYTES / RSS_BLOCK, i, base, peak, after;
+	char **blocks = malloc(n * sizeof(char *));
+
+	if (blocks == NULL)
+	{
+		printf("FAIL: can't allocate the block array\n");
+		failures++;
+		return;
+	}
+	base = rss();
+	for (i = 0; i < n; i++)
+		if ((blocks[i] = malloc(RSS_BLOCK)) != NULL)
+			memset(blocks[i], 1, RSS_BLOCK);
+	peak = rss();
+
+	for (i = 0; i + 1 < n; i++)
+		free(blocks[i]);
+	after = rss();
+	printf("preloadtest: rss %zuMB, %zuMB with %zuMB live, %zuMB with one block live\n",
+		   base >> 20, peak >> 20, RSS_BYTES >> 20, after >> 20);
+	check(after < base + RSS_SLACK, "freed interior released", after);
+
+	free(blocks[n - 1]);
+	after = rss();
+	printf("preloadtest: rss %zuMB with none live\n", after >> 20);
+	check(after < base + RSS_SLACK, "freed heap top released", after);
+	free(blocks);
+}
+
+/*
+ * refused - Did an allocation return NULL with errno set to ENOMEM?
+ */
+static int refused(void *p)
+{
+	int ok = p == NULL && errno == ENOMEM;
+
+	free(p);
+	return ok;
+}
+
+int main(void)
+{
+	size_t pagesize = sysconf(_SC_PAGESIZE);
+	size_t i, size;
+	char *volatile small, *volatile big; /* not freed by a failed realloc */
+	char *p;
+	void *q;
+
+	small = malloc(100);
+	big = malloc(1 << 20); /* mapped outside the heap */
+	if (small == NULL || big == NULL)
+	{
+		printf("FAIL: can't allocate the realloc blocks\n");
+		return 1;
+	}
+	memset(small, 'a', 100);
+	memset(big, 'b', 1 << 20);
+
+	for (i = 0; i < NHUGE; i++)
+	{
+		size = huge[i];
+		errno = 0;
+		check(refused(malloc(size)), "malloc", size);
+		errno = 0;
+		check(refused(calloc(1, size)), "calloc", size);
+		errno = 0;
+		check(refused(calloc(size / 2 + 1, 2)), "calloc (product)", size);
+		errno = 0;
+		check(refused(memalign(64, size)), "memalign", size);
+		errno = 0;
+		check(refused(aligned_alloc(4096, size)), "aligned_alloc", size);
+		errno = 0;
+		check(refused(valloc(size)), "valloc", size);
+		errno = 0;
+		check(refused(pvalloc(size)), "pvalloc", size);
+		q = NULL;
+		check(posix_memalign(&q, 64, size) == ENOMEM && q == NULL, "posix_memalign", size);
+
+		errno = 0;
+		check(refused(realloc(small, size)), "realloc", size);
+		errno = 0;
+		check(refused(realloc(big, size)), "realloc (mapped)", size);
+	}
+	for (i = 0; i < 100; i++)
+		check(small[i] == 'a', "realloc kept the block", i);
+	for (i = 0; i < (1 << 20); i++)
+		if (big[i] != 'b')
+			break;
+	check(i == (1 << 20), "realloc kept the mapped block", i);
+	free(small);
+	free(big);
+
+	/* Still usable afterwards */
+	p = pvalloc(1);
+	check(p != NULL && ((uintptr_t)p & (pagesize - 1)) == 0 &&
+			  malloc_usable_size(p) >= pagesize,
+		  "pvalloc rounds to a page", 1);
+	free(p);
+	p = malloc(0);
+	check(p != NULL, "malloc(0)", 0);
+	free(p);
+
+	check_rss();
+
+	if (failures == 0)
+		printf("preloadtest: all checks passed\n");
+	return failures != 0;
+}
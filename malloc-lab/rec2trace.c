@@ -0,0 +1,363 @@
+/*
+ * rec2trace.c - Turn a librecord.so allocation log into a trace file
+ *
+ * usage: rec2trace [-hrv] <log> <trace>
+ *
+ * The records of all threads are replayed in time order. Every block
+ * gets a dense id in the order it was allocated, and a realloc keeps
+ * the id of the block it resizes. As checktrace.pl does for the ASCII
+ * traces, a free request is appended for every block still allocated
+ * at the end, so the trace is balanced. The output is a binary trace,
+ * or ASCII with -r.
+ *
+ * A few calls can't be replayed exactly, and are adjusted:
+ *   - free of a block the log never saw allocated (e.g. one allocated
+ *     before recording started) is dropped;
+ *   - an allocation that returns the address of a block that is still
+ *     allocated frees that block first (threads racing on one address,
+ *     whose timestamps came out of order);
+ *   - 0-byte requests become 1-byte requests, which mdriver accepts;
+ *   - alignments are not kept.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "record.h"
+#include "trace.h"
+
+/* A live block: its address, trace id and requested size */
+typedef struct
+{
+	uint64_t addr; /* 0 if the slot is empty */
+	int id;
+	size_t size;
+} live_t;
+
+/* Sort key for one record: its timestamp and position in the log */
+typedef struct
+{
+	uint64_t ns;
+	size_t idx;
+} order_t;
+
+/* Blocks allocated and not yet freed, hashed by address */
+static live_t *live;
+static size_t live_slots, live_used, live_bytes;
+
+/* The requests of the trace being built */
+static traceop_t *ops;
+static size_t num_ops, max_ops;
+
+#define ADDR_HASH(a) ((size_t)(((a) >> 4) * 0x9E3779B97F4A7C15ULL) & (live_slots - 1))
+
+static live_t *live_find(uint64_t addr);
+static live_t *live_add(uint64_t addr);
+static void live_remove(live_t *e);
+static void emit(int type, int id, size_t size);
+static void emit_free(live_t *e);
+static int cmp_key(const void *a, const void *b);
+static int cmp_int(const void *a, const void *b);
+static void usage(void);
+static void fail(const char *what, const char *msg);
+
+int main(int argc, char **argv)
+{
+	int c, to_rep = 0, verbose = 0;
+	int id, next_id = 0;
+	const rec_t *recs, *r;
+	order_t *keys;
+	size_t nrecs, i, n;
+	size_t dropped = 0, raced = 0, peak_bytes = 0;
+	struct stat st;
+	char *map;
+	int fd, *ids;
+	live_t *e;
+	uint64_t addr;
+	trace_t trace;
+	FILE *fp;
+
+	while ((c = getopt(argc, argv, "hrv")) != EOF)
+	{
+		switch (c)
+		{
+		case 'r':
+			to_rep = 1;
+			break;
+		case 'v':
+			verbose = 1;
+			break;
+		case 'h':
+			usage();
+			exit(0);
+		default:
+			usage();
+			exit(1);
+		}
+	}
+	if (argc - optind != 2)
+	{
+		usage();
+		exit(1);
+	}
+
+	/* Map the log and sort its records by time */
+	if ((fd = open(argv[optind], O_RDONLY)) < 0 || fstat(fd, &st) < 0)
+		fail(argv[optind], strerror(errno));
+	if (st.st_size < 8)
+		fail(argv[optind], "not an allocation log");
+	map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	if (map == MAP_FAILED)
+		fail(argv[optind], strerror(errno));
+	if (memcmp(map, REC_MAGIC, 8) != 0)
+		fail(argv[optind], "not an allocation log");
+	recs = (const rec_t *)(map + 8);
+	nrecs = (st.st_size - 8) / sizeof(rec_t);
+
+	if ((keys = (order_t *)malloc(nrecs * sizeof(order_t) + 1)) == NULL)
+		fail("keys", "malloc failed");
+	for (i = 0; i < nrecs; i++)
+	{
+		keys[i].ns = recs[i].ns;
+		keys[i].idx = i;
+	}
+	qsort(keys, nrecs, sizeof(order_t), cmp_key);
+
+	live_slots = 1024;
+	if ((live = (live_t *)calloc(live_slots, sizeof(live_t))) == NULL)
+		fail("live table", "calloc failed");
+
+	/* Replay the calls, naming blocks by dense ids */
+	for (i = 0; i < nrecs; i++)
+	{
+		r = &recs[keys[i].idx];
+		switch (r->op)
+		{
+		case REC_MALLOC:
+		case REC_CALLOC:
+		case REC_MEMALIGN:
+		case REC_REALLOC:
+			/* realloc(NULL, n) and realloc of an unknown block allocate */
+			if (r->op == REC_REALLOC && r->old != 0 && (e = live_find(r->old)) != NULL)
+			{
+				if (r->ptr == 0)
+				{
+					/* realloc(p, 0) freed p */
+					emit_free(e);
+					break;
+				}
+				if (r->ptr != r->old && (e = live_find(r->ptr)) != NULL)
+				{
+					emit_free(e);
+					raced++;
+				}
+				e = live_find(r->old);
+				live_bytes += r->size - e->size;
+				e->size = r->size;
+				emit(REALLOC, e->id, r->size);
+				if (r->ptr != r->old)
+				{
+					addr = r->ptr;
+					id = e->id;
+					n = e->size;
+					live_remove(e);
+					e = live_add(addr);
+					e->id = id;
+					e->size = n;
+				}
+			}
+			else
+			{
+				if (r->ptr == 0)
+					break;
+				if ((e = live_find(r->ptr)) != NULL)
+				{
+					emit_free(e);
+					raced++;
+				}
+				if (next_id == INT_MAX)
+					fail(argv[optind], "too many blocks for one trace");
+				e = live_add(r->ptr);
+				e->id = next_id++;
+				e->size = r->size;
+				live_bytes += r->size;
+				emit(ALLOC, e->id, r->size);
+			}
+			break;
+
+		case REC_FREE:
+			if ((e = live_find(r->ptr)) != NULL)
+				emit_free(e);
+			else
+				dropped++;
+			break;
+
+		default:
+			fail(argv[optind], "corrupt record");
+		}
+		peak_bytes = (live_bytes > peak_bytes) ? live_bytes : peak_bytes;
+	}
+
+	/* Balance the trace: free what is still allocated, by id */
+	n = live_used;
+	if ((ids = (int *)malloc(n * sizeof(int) + 1)) == NULL)
+		fail("ids", "malloc failed");
+	for (i = 0, n = 0; i < live_slots; i++)
+		if (live[i].addr != 0)
+			ids[n++] = live[i].id;
+	qsort(ids, n, sizeof(int), cmp_int);
+	for (i = 0; i < n; i++)
+		emit(FREE, ids[i], 0);
+
+	if (num_ops > INT_MAX)
+		fail(argv[optind], "too many requests for one trace");
+	memset(&trace, 0, sizeof(trace));
+	trace.sugg_heapsize = (peak_bytes > INT_MAX) ? INT_MAX : peak_bytes;
+	trace.num_ids = next_id;
+	trace.num_ops = num_ops;
+	trace.weight = 1;
+	trace.ops = ops;
+
+	if ((fp = fopen(argv[optind + 1], "w")) == NULL)
+		fail(argv[optind + 1], strerror(errno));
+	if ((to_rep ? trace_write_rep(&trace, fp) : trace_write_bin(&trace, fp)) < 0 ||
+		fclose(fp) != 0)
+		fail(argv[optind + 1], strerror(errno));
+
+	if (verbose)
+	{
+		printf("%zu calls logged\n", nrecs);
+		printf("%d ids, %zu requests (%zu frees added to balance)\n",
+			   next_id, num_ops, n);
+		printf("%zu bytes peak live payload\n", peak_bytes);
+		printf("%zu frees of unknown blocks dropped\n", dropped);
+		printf("%zu reused addresses freed early\n", raced);
+	}
+	return 0;
+}
+
+/*
+ * live_find - Return the live block at addr, or NULL
+ */
+static live_t *live_find(uint64_t addr)
+{
+	size_t i;
+
+	for (i = ADDR_HASH(addr); live[i].addr != 0; i = (i + 1) & (live_slots - 1))
+		if (live[i].addr == addr)
+			return &live[i];
+	return NULL;
+}
+
+/*
+ * live_add - Add a live block at addr, which must not be in the table.
+ *     The table doubles once it is half full.
+ */
+static live_t *live_add(uint64_t addr)
+{
+	live_t *old = live;
+	size_t n = live_slots, i;
+
+	if (2 * (live_used + 1) > live_slots)
+	{
+		live_slots *= 2;
+		live_used = 0;
+		if ((live = (live_t *)calloc(live_slots, sizeof(live_t))) == NULL)
+			fail("live table", "calloc failed");
+		for (i = 0; i < n; i++)
+			if (old[i].addr != 0)
+				*live_add(old[i].addr) = old[i];
+		free(old);
+	}
+	for (i = ADDR_HASH(addr); live[i].addr != 0; i = (i + 1) & (live_slots - 1))
+		;
+	live[i].addr = addr;
+	live_used++;
+	return &live[i];
+}
+
+/*
+ * live_remove - Remove a block from the table, shifting the rest of
+ *     its probe run back so that no tombstones are needed
+ */
+static void live_remove(live_t *e)
+{
+	size_t mask = live_slots - 1;
+	size_t i = e - live, j = i, k;
+
+	for (;;)
+	{
+		j = (j + 1) & mask;
+		if (live[j].addr == 0)
+			break;
+		k = ADDR_HASH(live[j].addr);
+		if ((i <= j) ? (i < k && k <= j) : (i < k || k <= j))
+			continue;
+		live[i] = live[j];
+		i = j;
+	}
+	live[i].addr = 0;
+	live_used--;
+}
+
+/*
+ * emit - Append a request to the trace
+ */
+static void emit(int type, int id, size_t size)
+{
+	if (num_ops == max_ops)
+	{
+		max_ops = max_ops ? 2 * max_ops : 65536;
+		if ((ops = (traceop_t *)realloc(ops, max_ops * sizeof(traceop_t))) == NULL)
+			fail("requests", "realloc failed");
+	}
+	ops[num_ops].type = type;
+	ops[num_ops].index = id;
+	ops[num_ops].size = (type != FREE && size == 0) ? 1 : size;
+	num_ops++;
+}
+
+/*
+ * emit_free - Free a live block
+ */
+static void emit_free(live_t *e)
+{
+	emit(FREE, e->id, 0);
+	live_bytes -= e->size;
+	live_remove(e);
+}
+
+static int cmp_key(const void *a, const void *b)
+{
+	const order_t *x = a, *y = b;
+
+	if (x->ns != y->ns)
+		return (x->ns < y->ns) ? -1 : 1;
+	return (x->idx < y->idx) ? -1 : (x->idx > y->idx);
+}
+
+static int cmp_int(const void *a, const void *b)
+{
+	return *(const int *)a - *(const int *)b;
+}
+
+static void usage(void)
+{
+	fprintf(stderr, "Usage: rec2trace [-hrv] <log> <trace>\n");
+	fprintf(stderr, "Options\n");
+	fprintf(stderr, "\t-h         Print this message.\n");
+	fprintf(stderr, "\t-r         Write an ASCII .rep trace (default: binary).\n");
+	fprintf(stderr, "\t-v         Print a summary of the conversion.\n");
+}
+
+static void fail(const char *what, const char *msg)
+{
+	fprintf(stderr, "rec2trace: %s: %s\n", what, msg);
+	exit(1);
+}
@@ -0,0 +1,37 @@
+/*
+ * record.h - Format of the allocation logs written by librecord.so
+ *
+ * A log is REC_MAGIC followed by rec_t records in host byte order.
+ * Each thread's records appear in the order the thread made its calls,
+ * but the threads' records are interleaved in no particular order;
+ * rec2trace sorts them by time.
+ */
+#ifndef __RECORD_H_
+#define __RECORD_H_
+
+#include <stdint.h>
+
+#define REC_MAGIC "MLRECLG1" /* 8 bytes, no terminator in the file */
+
+/* Kinds of recorded calls */
+enum
+{
+	REC_MALLOC,	  /* malloc */
+	REC_CALLOC,	  /* calloc */
+	REC_REALLOC,  /* realloc */
+	REC_MEMALIGN, /* posix_memalign, memalign, aligned_alloc */
+	REC_FREE	  /* free */
+};
+
+/* One recorded call */
+typedef struct
+{
+	uint64_t ns;   /* CLOCK_MONOTONIC time: after the call, or before a free */
+	uint64_t ptr;  /* block returned, or the block freed */
+	uint64_t old;  /* block passed to realloc */
+	uint64_t size; /* bytes requested (nmemb * size for calloc) */
+	uint32_t tid;  /* kernel thread id of the caller */
+	uint32_t op;   /* REC_xxx */
+} rec_t;
+
+#endif /* __RECORD_H_ */
@@ -0,0 +1,542 @@
+/*
+ * recorder.c - LD_PRELOAD library that records the allocation calls
+ *     of a real program, for rec2trace to turn into a trace file
+ *
+ * usage: LD_PRELOAD=./librecord.so RECORD_FILE=app.log <program>
+ *
+ * malloc, free, realloc, calloc, posix_memalign, memalign and
+ * aligned_alloc are passed to the C library and logged with the
+ * caller's thread id and a timestamp (see record.h). Without
+ * RECORD_FILE the log is record.<pid>.log; a forked child writes
+ * <name>.<pid> next to its parent's log.
+ *
+ * Each thread appends records to a private buffer without locking.
+ * A full buffer is pushed onto a lock-free list, and a flusher thread
+ * writes the list out every REC_FLUSH_MS, so no caller ever waits for
+ * the disk. Buffers are mmapped and unmapped, never recycled, so the
+ * list is only ever pushed to and swapped out whole. A thread's partial
+ * buffer is written when it exits, and at process exit those of the
+ * first REC_MAX_THREADS live threads are written too. A thread that is
+ * in the middle of a record then is waited for briefly; if it is still
+ * there after REC_EXIT_SPINS yields (stopped, say), its buffer is left
+ * alone and its records since the last full buffer are not written.
+ * Calls made after exit has begun are not recorded.
+ */
+#define _GNU_SOURCE
+#include <dlfcn.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+
+#include "record.h"
+
+#define REC_BUF_RECS 65536	 /* records per thread buffer */
+#define REC_MAX_THREADS 1024 /* threads whose buffers are tracked for exit */
+#define REC_FLUSH_MS 10		 /* flusher period */
+#define REC_EXIT_SPINS 1000	 /* yields to wait at exit for a thread inside record */
+#define BOOT_SIZE 65536		 /* arena for calls made while dlsym runs */
+
+/* Thread-local variables must not be allocated with malloc */
+#define TLS __thread __attribute__((tls_model("initial-exec")))
+
+/* A thread's record buffer, and its link on the list of full buffers */
+typedef struct recbuf
+{
+	struct recbuf *next;
+	size_t n;
+	rec_t recs[REC_BUF_RECS];
+} recbuf_t;
+
+/* Where a thread keeps its buffer, so exit can find it */
+typedef struct
+{
+	atomic_int used;
+	atomic_int active; /* owner is inside record: exit must not take buf */
+	recbuf_t *_Atomic buf;
+} slot_t;
+
+/* The C library's allocator */
+static void *(*real_malloc)(size_t);
+static void (*real_free)(void *);
+static void *(*real_realloc)(void *, size_t);
+static void *(*real_calloc)(size_t, size_t);
+static int (*real_posix_memalign)(void **, size_t, size_t);
+static void *(*real_memalign)(size_t, size_t);
+static void *(*real_aligned_alloc)(size_t, size_t);
+
+static int log_fd = -1;
+static char log_name[4096];
+static atomic_int recording;		   /* log calls? */
+static recbuf_t *_Atomic full_list;	   /* buffers waiting for the flusher */
+static atomic_int flusher_started;
+static atomic_int flusher_stop;
+static pthread_t flusher_tid;
+static slot_t slots[REC_MAX_THREADS];
+static pthread_key_t exit_key;		   /* flushes a thread's buffer at exit */
+
+static TLS slot_t *my_slot; /* this thread's slot (or own_slot) */
+static TLS slot_t own_slot; /* used once all REC_MAX_THREADS slots are taken */
+static TLS int busy;		/* inside a wrapper: pass nested calls through */
+static TLS uint32_t my_tid;
+
+/* Bootstrap arena; each block is preceded by its size */
+static char boot[BOOT_SIZE] __attribute__((aligned(16)));
+static size_t boot_used;
+#define IN_BOOT(p) ((char *)(p) >= boot && (char *)(p) < boot + BOOT_SIZE)
+
+static void resolve(void);
+static void *boot_alloc(size_t size);
+static void record(int op, void *ptr, void *old, size_t size);
+static void append(slot_t *s, int op, void *ptr, void *old, size_t size);
+static slot_t *claim_slot(void);
+static void push_full(recbuf_t *b);
+static void *flusher(void *arg);
+static void drain(void);
+static void open_log(void);
+static void thread_exit(void *arg);
+static void atfork_child(void);
+
+/**********************
+ * The wrapped routines
+ **********************/
+
+void *malloc(size_t size)
+{
+	void *p;
+
+	if (real_malloc == NULL && (resolve(), real_malloc == NULL))
+		return boot_alloc(size);
+	if (busy)
+		return real_malloc(size);
+	busy = 1;
+	if ((p = real_malloc(size)) != NULL)
+		record(REC_MALLOC, p, NULL, size);
+	busy = 0;
+	return p;
+}
+
+void free(void *ptr)
+{
+	if (ptr == NULL || IN_BOOT(ptr))
+		return;
+	if (real_free == NULL && (resolve(), real_free == NULL))
+		return;
+	if (busy)
+	{
+		real_free(ptr);
+		return;
+	}
+	busy = 1;
+	record(REC_FREE, ptr, NULL, 0);
+	real_free(ptr);
+	busy = 0;
+}
+
+void *realloc(void *ptr, size_t size)
+{
+	void *p;
+	size_t old_size;
+
+	if (IN_BOOT(ptr))
+	{
+		/* Moved out of the arena; the log never saw the old block */
+		old_size = ((size_t *)ptr)[-2];
+		if ((p = malloc(size)) != NULL)
+			memcpy(p, ptr, old_size < size ? old_size : size);
+		return p;
+	}
+	if (real_realloc == NULL && (resolve(), real_realloc == NULL))
+		return NULL;
+	if (busy)
+		return real_realloc(ptr, size);
+	busy = 1;
+	p = real_realloc(ptr, size);
+	if (p != NULL || (ptr != NULL && size == 0))
+		record(REC_REALLOC, p, ptr, size);
+	busy = 0;
+	return p;
+}
+
+void *calloc(size_t nmemb, size_t size)
+{
+	void *p;
+
+	if (real_calloc == NULL && (resolve(), real_calloc == NULL))
+		return (nmemb && size > SIZE_MAX / nmemb) ? NULL : boot_alloc(nmemb * size);
+	if (busy)
+		return real_calloc(nmemb, size);
+	busy = 1;
+	if ((p = real_calloc(nmemb, size)) != NULL)
+		record(REC_CALLOC, p, NULL, nmemb * size);
+	busy = 0;
+	return p;
+}
+
+int posix_memalign(void **memptr, size_t alignment, size_t size)
+{
+	int err;
+
+	if (real_posix_memalign == NULL && (resolve(), real_posix_memalign == NULL))
+		return ENOMEM;
+	if (busy)
+		return real_posix_memalign(memptr, alignment, size);
+	busy = 1;
+	if ((err = real_posix_memalign(memptr, alignment, size)) == 0)
+		record(REC_MEMALIGN, *memptr, NULL, size);
+	busy = 0;
+	return err;
+}
+
+void *memalign(size_t alignment, size_t size)
+{
+	void *p;
+
+	if (real_memalign == NULL && (resolve(), real_memalign == NULL))
+		return NULL;
+	if (busy)
+		return real_memalign(alignment, size);
+	busy = 1;
+	if ((p = real_memalign(alignment, size)) != NULL)
+		record(REC_MEMALIGN, p, NULL, size);
+	busy = 0;
+	return p;
+}
+
+void *aligned_alloc(size_t alignment, size_t size)
+{
+	void *p;
+
+	if (real_aligned_alloc == NULL && (resolve(), real_aligned_alloc == NULL))
+		return NULL;
+	if (busy)
+		return real_aligned_alloc(alignment, size);
+	busy = 1;
+	if ((p = real_aligned_alloc(alignment, size)) != NULL)
+		record(REC_MEMALIGN, p, NULL, size);
+	busy = 0;
+	return p;
+}
+
+/*****************************
+ * Setting up and tearing down
+ *****************************/
+
+/*
+ * resolve - Look up the C library's allocator. dlsym may itself call
+ *     calloc or malloc; those calls find their real_xxx still NULL and
+ *     are served from the bootstrap arena.
+ */
+static void resolve(void)
+{
+	static int resolving = 0;
+
+	if (resolving)
+		return;
+	resolving = 1;
+	real_malloc = dlsym(RTLD_NEXT, "malloc");
+	real_free = dlsym(RTLD_NEXT, "free");
+	real_realloc = dlsym(RTLD_NEXT, "realloc");
+	real_calloc = dlsym(RTLD_NEXT, "calloc");
+	real_posix_memalign = dlsym(RTLD_NEXT, "posix_memalign");
+	real_memalign = dlsym(RTLD_NEXT, "memalign");
+	real_aligned_alloc = dlsym(RTLD_NEXT, "aligned_alloc");
+	resolving = 0;
+}
+
+/*
+ * boot_alloc - Carve a zeroed block out of the bootstrap arena
+ */
+static void *boot_alloc(size_t size)
+{
+	size_t *p;
+
+	size = (size + 15) & ~(size_t)15;
+	if (boot_used + 16 + size > BOOT_SIZE)
+		return NULL;
+	p = (size_t *)(boot + boot_used + 16);
+	p[-2] = size;
+	boot_used += 16 + size;
+	return p;
+}
+
+/*
+ * rec_init - Open the log and start recording
+ */
+static void __attribute__((constructor)) rec_init(void)
+{
+	const char *name;
+
+	busy = 1;
+	if (real_malloc == NULL)
+		resolve();
+	if ((name = getenv("RECORD_FILE")) != NULL)
+		snprintf(log_name, sizeof(log_name), "%s", name);
+	else
+		snprintf(log_name, sizeof(log_name), "record.%d.log", (int)getpid());
+	open_log();
+	pthread_key_create(&exit_key, thread_exit);
+	pthread_atfork(NULL, NULL, atfork_child);
+	atomic_store(&recording, log_fd >= 0);
+	busy = 0;
+}
+
+/*
+ * rec_fini - Stop recording and write every buffer out. Other threads
+ *     are still running, so a slot's buffer is taken only once its
+ *     owner is seen outside record; after that the owner sees recording
+ *     off and never touches the buffer again (see record).
+ */
+static void __attribute__((destructor)) rec_fini(void)
+{
+	recbuf_t *b;
+	int i, spins;
+
+	busy = 1;
+	atomic_store(&recording, 0);
+	for (i = 0; i < REC_MAX_THREADS; i++)
+	{
+		if (!atomic_load(&slots[i].used))
+			continue;
+		for (spins = 0; atomic_load(&slots[i].active) && spins < REC_EXIT_SPINS; spins++)
+			sched_yield();
+		if (!atomic_load(&slots[i].active) && (b = atomic_exchange(&slots[i].buf, NULL)) != NULL)
+			push_full(b);
+	}
+	if (my_slot == &own_slot && (b = atomic_exchange(&own_slot.buf, NULL)) != NULL)
+		push_full(b);
+	if (atomic_load(&flusher_started))
+	{
+		atomic_store(&flusher_stop, 1);
+		pthread_join(flusher_tid, NULL);
+	}
+	drain();
+	if (log_fd >= 0)
+		close(log_fd);
+	log_fd = -1;
+}
+
+/*
+ * open_log - Create the log file and write its magic number
+ */
+static void open_log(void)
+{
+	log_fd = open(log_name, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+	if (log_fd < 0 || write(log_fd, REC_MAGIC, 8) != 8)
+	{
+		fprintf(stderr, "librecord: can't write %s: %s\n", log_name, strerror(errno));
+		if (log_fd >= 0)
+			close(log_fd);
+		log_fd = -1;
+	}
+}
+
+/*
+ * atfork_child - Give a forked child its own log. The buffers it
+ *     inherited belong to the parent, which writes them itself.
+ */
+static void atfork_child(void)
+{
+	char parent[sizeof(log_name)];
+	recbuf_t *b;
+	int i;
+
+	atomic_store(&full_list, NULL);
+	atomic_store(&flusher_started, 0);
+	atomic_store(&flusher_stop, 0);
+	for (i = 0; i < REC_MAX_THREADS; i++)
+		if (&slots[i] != my_slot)
+		{
+			atomic_store(&slots[i].buf, NULL);
+			atomic_store(&slots[i].used, 0);
+		}
+	if (my_slot != NULL && (b = atomic_load(&my_slot->buf)) != NULL)
+		b->n = 0;
+	my_tid = 0;
+
+	if (log_fd >= 0)
+		close(log_fd);
+	memcpy(parent, log_name, sizeof(parent));
+	snprintf(log_name, sizeof(log_name), "%.4000s.%d", parent, (int)getpid());
+	open_log();
+	atomic_store(&recording, log_fd >= 0);
+}
+
+/************************
+ * Recording and flushing
+ ************************/
+
+/*
+ * record - Append one call to this thread's buffer. Takes no locks.
+ *     The slot is marked active before recording is checked again, and
+ *     rec_fini turns recording off before it checks active, so either
+ *     it sees this call and leaves the buffer alone or this call sees
+ *     recording off (both accesses are sequentially consistent).
+ */
+static void record(int op, void *ptr, void *old, size_t size)
+{
+	slot_t *s;
+
+	if (!atomic_load_explicit(&recording, memory_order_relaxed))
+		return;
+	if ((s = my_slot) == NULL)
+		s = my_slot = claim_slot();
+	atomic_store(&s->active, 1);
+	if (atomic_load(&recording))
+		append(s, op, ptr, old, size);
+	atomic_store_explicit(&s->active, 0, memory_order_release);
+}
+
+/*
+ * append - Add a record to slot s's buffer; a full buffer is handed to
+ *     the flusher and replaced by a new one
+ */
+static void append(slot_t *s, int op, void *ptr, void *old, size_t size)
+{
+	recbuf_t *b;
+	rec_t *r;
+	struct timespec ts;
+
+	b = atomic_load_explicit(&s->buf, memory_order_relaxed);
+	if (b == NULL || b->n == REC_BUF_RECS)
+	{
+		if (b != NULL)
+			push_full(b);
+		b = mmap(NULL, sizeof(recbuf_t), PROT_READ | PROT_WRITE,
+				 MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+		if (b == MAP_FAILED)
+			b = NULL;
+		atomic_store_explicit(&s->buf, b, memory_order_release);
+		if (b == NULL)
+			return;
+	}
+	if (my_tid == 0)
+		my_tid = syscall(SYS_gettid);
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	r = &b->recs[b->n];
+	r->ns = (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+	r->ptr = (uintptr_t)ptr;
+	r->old = (uintptr_t)old;
+	r->size = size;
+	r->tid = my_tid;
+	r->op = op;
+	b->n++;
+}
+
+/*
+ * claim_slot - Give the calling thread a slot, and arrange for its
+ *     buffer to be flushed when it exits
+ */
+static slot_t *claim_slot(void)
+{
+	int i, expected;
+
+	for (i = 0; i < REC_MAX_THREADS; i++)
+	{
+		expected = 0;
+		if (atomic_load_explicit(&slots[i].used, memory_order_relaxed) == 0 &&
+			atomic_compare_exchange_strong(&slots[i].used, &expected, 1))
+		{
+			pthread_setspecific(exit_key, &slots[i]);
+			return &slots[i];
+		}
+	}
+	pthread_setspecific(exit_key, &own_slot);
+	return &own_slot;
+}
+
+/*
+ * thread_exit - Hand a finished thread's buffer to the flusher and
+ *     free its slot
+ */
+static void thread_exit(void *arg)
+{
+	slot_t *s = (slot_t *)arg;
+	recbuf_t *b;
+
+	if ((b = atomic_exchange(&s->buf, NULL)) != NULL)
+		push_full(b);
+	if (s != &own_slot)
+		atomic_store(&s->used, 0);
+	my_slot = NULL;
+}
+
+/*
+ * push_full - Push a buffer onto the list of full buffers, starting the
+ *     flusher thread the first time
+ */
+static void push_full(recbuf_t *b)
+{
+	recbuf_t *head = atomic_load(&full_list);
+
+	do
+		b->next = head;
+	while (!atomic_compare_exchange_weak(&full_list, &head, b));
+
+	if (atomic_load(&recording) && !atomic_exchange(&flusher_started, 1) &&
+		pthread_create(&flusher_tid, NULL, flusher, NULL) != 0)
+		atomic_store(&flusher_started, 0);
+}
+
+/*
+ * flusher - Body of the flusher thread
+ */
+static void *flusher(void *arg)
+{
+	struct timespec ts = {0, REC_FLUSH_MS * 1000000L};
+
+	busy = 1;
+	while (!atomic_load(&flusher_stop))
+	{
+		nanosleep(&ts, NULL);
+		drain();
+	}
+	return NULL;
+}
+
+/*
+ * drain - Write out and unmap every buffer on the full list. The list
+ *     is a stack, so it is reversed first to keep each thread's
+ *     buffers in the order they filled.
+ */
+static void drain(void)
+{
+	recbuf_t *b, *next, *fifo = NULL;
+	char *p;
+	size_t left;
+	ssize_t n;
+
+	for (b = atomic_exchange(&full_list, NULL); b != NULL; b = next)
+	{
+		next = b->next;
+		b->next = fifo;
+		fifo = b;
+	}
+	for (b = fifo; b != NULL; b = next)
+	{
+		next = b->next;
+		p = (char *)b->recs;
+		left = b->n * sizeof(rec_t);
+		while (log_fd >= 0 && left > 0)
+		{
+			if ((n = write(log_fd, p, left)) < 0)
+			{
+				if (errno == EINTR)
+					continue;
+				break;
+			}
+			p += n;
+			left -= n;
+		}
+		munmap(b, sizeof(recbuf_t));
+	}
+}
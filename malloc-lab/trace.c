@@ -0,0 +1,703 @@
+/*
+ * trace.c - Read and write malloc lab trace files
+ *
+ * ASCII .rep traces are parsed into an array of requests. Binary
+ * traces are mapped read-only and are never copied: trace_next()
+ * decodes their packed records in place while the driver replays them,
+ * so loading one costs a single mmap no matter how long it is.
+ *
+ * A streamed trace of either format is never held in memory. A reader
+ * thread decodes it into two TRACE_CHUNK-request buffers: while the
+ * driver replays one, the reader fills the other. The driver's id table
+ * for a streamed trace is an open-addressed hash of the live ids rather
+ * than an array of num_ids entries, so memory stays bounded by the
+ * number of live blocks, not by the length of the recording.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <limits.h>
+#include <pthread.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "trace.h"
+
+/* Reads a streamed trace ahead of the driver (see trace_refill) */
+struct trace_stream
+{
+	FILE *fp;
+	char *path;			  /* for error messages */
+	int bin;			  /* binary trace? */
+	long start;			  /* file offset of the first request */
+	int left;			  /* requests the reader has not read yet */
+	int64_t index;		  /* id of the previous binary record */
+	traceop_t *buf[2];	  /* the two chunk buffers... */
+	int len[2];			  /* ... the number of requests in each... */
+	int ready[2];		  /* ... and whether each is filled and not replayed */
+	int cur;			  /* buffer being replayed, or -1 */
+	int stop;			  /* tells the reader thread to quit */
+	int running;		  /* is the reader thread running? */
+	pthread_t tid;
+	pthread_mutex_t lock; /* protects len, ready and stop */
+	pthread_cond_t cond;  /* signals a change to ready or stop */
+};
+
+static trace_t *read_rep(FILE *fp, const char *path);
+static trace_t *map_bin(int fd, const char *path);
+static void read_rep_hdr(FILE *fp, trace_t *trace, const char *path);
+static void check_bin_hdr(const trace_hdr_t *hdr, off_t file_size,
+						  trace_t *trace, const char *path);
+static int get_rep_op(FILE *fp, traceop_t *op, const char *path);
+static int get_bin_op(trace_stream_t *s, traceop_t *op);
+static int get_varint(FILE *fp, uint64_t *v);
+static void alloc_blocks(trace_t *trace, const char *path);
+static void *stream_thread(void *ptr);
+static void stream_stop(trace_stream_t *s);
+static int put_varint(uint64_t v, FILE *fp);
+static void trace_error(const char *path, const char *msg);
+
+/*
+ * trace_read - Read the trace file at path. Binary traces are told
+ *     apart from .rep files by their magic number.
+ */
+trace_t *trace_read(const char *path)
+{
+	FILE *fp;
+	char magic[sizeof(TRACE_MAGIC) - 1];
+	trace_t *trace;
+
+	if ((fp = fopen(path, "r")) == NULL)
+		trace_error(path, strerror(errno));
+
+	if (fread(magic, 1, sizeof(magic), fp) == sizeof(magic) &&
+		memcmp(magic, TRACE_MAGIC, sizeof(magic)) == 0)
+		trace = map_bin(fileno(fp), path);
+	else
+	{
+		rewind(fp);
+		trace = read_rep(fp, path);
+	}
+	fclose(fp);
+	return trace;
+}
+
+/*
+ * read_rep - Parse an ASCII trace and store its requests in memory
+ */
+static trace_t *read_rep(FILE *fp, const char *path)
+{
+	trace_t *trace;
+	traceop_t op;
+	int max_index = 0;
+	int op_index;
+
+	if ((trace = (trace_t *)calloc(1, sizeof(trace_t))) == NULL)
+		trace_error(path, "calloc failed");
+	read_rep_hdr(fp, trace, path);
+
+	/* We'll store each request line in the trace in this array */
+	if ((trace->ops = (traceop_t *)malloc(trace->num_ops * sizeof(traceop_t))) == NULL)
+		trace_error(path, "malloc failed");
+	alloc_blocks(trace, path);
+
+	/* read every request line in the trace file */
+	op_index = 0;
+	while (get_rep_op(fp, &op, path))
+	{
+		if (op_index == trace->num_ops)
+			trace_error(path, "more requests than the header says");
+		if (op.type != FREE)
+			max_index = (op.index > max_index) ? op.index : max_index;
+		trace->ops[op_index++] = op;
+	}
+	if (trace->num_ops > 0 && max_index != trace->num_ids - 1)
+		trace_error(path, "ids do not match the header");
+	if (op_index != trace->num_ops)
+		trace_error(path, "fewer requests than the header says");
+
+	return trace;
+}
+
+/*
+ * map_bin - Map a binary trace read-only. Only the header is checked
+ *     here; the records are checked as trace_next() decodes them.
+ */
+static trace_t *map_bin(int fd, const char *path)
+{
+	struct stat st;
+	trace_hdr_t hdr;
+	trace_t *trace;
+	unsigned char *map;
+
+	if (fstat(fd, &st) < 0)
+		trace_error(path, strerror(errno));
+	if ((size_t)st.st_size < sizeof(hdr))
+		trace_error(path, "truncated binary trace header");
+	map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	if (map == MAP_FAILED)
+		trace_error(path, strerror(errno));
+	madvise(map, st.st_size, MADV_SEQUENTIAL);
+
+	if ((trace = (trace_t *)calloc(1, sizeof(trace_t))) == NULL)
+		trace_error(path, "calloc failed");
+	memcpy(&hdr, map, sizeof(hdr));
+	check_bin_hdr(&hdr, st.st_size, trace, path);
+	if (hdr.recs_len > 0 && (map[st.st_size - 1] & 0x80))
+		trace_error(path, "truncated binary trace record");
+	trace->recs = map + sizeof(hdr);
+	trace->recs_len = hdr.recs_len;
+	trace->map = map;
+	trace->map_len = st.st_size;
+	alloc_blocks(trace, path);
+
+	return trace;
+}
+
+/*
+ * trace_open_stream - Open the trace file at path for streaming. Only
+ *     the header is read here; the requests are read by a thread that
+ *     each walk starts (see trace_rewind).
+ */
+trace_t *trace_open_stream(const char *path)
+{
+	trace_t *trace;
+	trace_stream_t *s;
+	trace_hdr_t hdr;
+	struct stat st;
+	size_t i;
+
+	if ((trace = (trace_t *)calloc(1, sizeof(trace_t))) == NULL ||
+		(s = (trace_stream_t *)calloc(1, sizeof(trace_stream_t))) == NULL)
+		trace_error(path, "calloc failed");
+	if ((s->fp = fopen(path, "r")) == NULL || fstat(fileno(s->fp), &st) < 0)
+		trace_error(path, strerror(errno));
+	if ((s->path = strdup(path)) == NULL)
+		trace_error(path, "strdup failed");
+
+	if (fread(&hdr, sizeof(hdr), 1, s->fp) == 1 &&
+		memcmp(hdr.magic, TRACE_MAGIC, sizeof(hdr.magic)) == 0)
+	{
+		check_bin_hdr(&hdr, st.st_size, trace, path);
+		s->bin = 1;
+	}
+	else
+	{
+		rewind(s->fp);
+		read_rep_hdr(s->fp, trace, path);
+	}
+	s->start = ftell(s->fp);
+	s->cur = -1;
+
+	for (i = 0; i < 2; i++)
+		if ((s->buf[i] = (traceop_t *)malloc(TRACE_CHUNK * sizeof(traceop_t))) == NULL)
+			trace_error(path, "malloc failed");
+	pthread_mutex_init(&s->lock, NULL);
+	pthread_cond_init(&s->cond, NULL);
+	trace->stream = s;
+
+	/* The id table starts small and grows with the number of live ids */
+	trace->nslots = TRACE_HASH_MIN;
+	if ((trace->blocks = (block_t *)malloc(trace->nslots * sizeof(block_t))) == NULL)
+		trace_error(path, "malloc failed");
+	for (i = 0; i < trace->nslots; i++)
+		trace->blocks[i].id = -1;
+
+	return trace;
+}
+
+/*
+ * read_rep_hdr - Read the 4-line header of an ASCII trace
+ */
+static void read_rep_hdr(FILE *fp, trace_t *trace, const char *path)
+{
+	if (fscanf(fp, "%d %d %d %d", &trace->sugg_heapsize, &trace->num_ids,
+			   &trace->num_ops, &trace->weight) != 4 ||
+		trace->num_ids < 0 || trace->num_ops < 0)
+		trace_error(path, "bad trace header");
+}
+
+/*
+ * check_bin_hdr - Check the header of a binary trace and copy it
+ */
+static void check_bin_hdr(const trace_hdr_t *hdr, off_t file_size,
+						  trace_t *trace, const char *path)
+{
+	if (hdr->version != TRACE_VERSION)
+		trace_error(path, "unsupported binary trace version");
+	if (hdr->num_ids > INT32_MAX || hdr->num_ops > INT32_MAX ||
+		hdr->recs_len != (uint64_t)file_size - sizeof(*hdr))
+		trace_error(path, "bad binary trace header");
+	trace->sugg_heapsize = hdr->sugg_heapsize;
+	trace->num_ids = hdr->num_ids;
+	trace->num_ops = hdr->num_ops;
+	trace->weight = hdr->weight;
+}
+
+/*
+ * get_rep_op - Parse the next request line of an ASCII trace.
+ *     Returns 0 at the end of the file.
+ */
+static int get_rep_op(FILE *fp, traceop_t *op, const char *path)
+{
+	char type[16];
+	unsigned index;
+	size_t size = 0;
+	int n;
+
+	if (fscanf(fp, "%15s", type) != 1)
+		return 0;
+	switch (type[0])
+	{
+	case 'a':
+		op->type = ALLOC;
+		n = fscanf(fp, "%u %zu", &index, &size);
+		break;
+	case 'r':
+		op->type = REALLOC;
+		n = fscanf(fp, "%u %zu", &index, &size);
+		break;
+	case 'f':
+		op->type = FREE;
+		n = fscanf(fp, "%u", &index) + 1;
+		break;
+	default:
+		fprintf(stderr, "Bogus type character (%c) in tracefile %s\n",
+				type[0], path);
+		exit(1);
+	}
+	if (n != 2)
+		trace_error(path, "malformed request line");
+	if (index > INT_MAX)
+		trace_error(path, "request id out of range");
+	op->index = index;
+	op->size = size;
+	return 1;
+}
+
+/*
+ * get_bin_op - Decode the next record of a streamed binary trace (see
+ *     trace_next). Returns 0 at the end of the file.
+ */
+static int get_bin_op(trace_stream_t *s, traceop_t *op)
+{
+	uint64_t v, zz;
+
+	if (!get_varint(s->fp, &v))
+		return 0;
+	zz = v >> 2;
+	s->index += (int64_t)(zz >> 1) ^ -(int64_t)(zz & 1);
+	if ((v & 3) > REALLOC || s->index < 0 || s->index > INT_MAX)
+		trace_error(s->path, "corrupt binary trace record");
+	op->type = v & 3;
+	op->index = s->index;
+	op->size = 0;
+	if (op->type != FREE)
+	{
+		if (!get_varint(s->fp, &v))
+			return 0;
+		op->size = v;
+	}
+	return 1;
+}
+
+/*
+ * get_varint - Read one LEB128 varint. Returns 0 at the end of the file.
+ */
+static int get_varint(FILE *fp, uint64_t *v)
+{
+	int c, shift = 0;
+
+	*v = 0;
+	do
+	{
+		if ((c = getc_unlocked(fp)) == EOF)
+			return 0;
+		if (shift < 64)
+			*v |= (uint64_t)(c & 0x7f) << shift;
+		shift += 7;
+	} while (c & 0x80);
+	return 1;
+}
+
+/*
+ * alloc_blocks - Allocate the per-id tables the driver fills in
+ */
+static void alloc_blocks(trace_t *trace, const char *path)
+{
+	/* We'll keep the pointers to the allocated blocks and their sizes here */
+	if ((trace->blocks = (block_t *)malloc(trace->num_ids * sizeof(block_t))) == NULL)
+		trace_error(path, "malloc failed");
+}
+
+/*
+ * trace_free - Free the trace record and everything it points to
+ */
+void trace_free(trace_t *trace)
+{
+	trace_stream_t *s = trace->stream;
+
+	if (s != NULL)
+	{
+		stream_stop(s);
+		fclose(s->fp);
+		pthread_mutex_destroy(&s->lock);
+		pthread_cond_destroy(&s->cond);
+		free(s->buf[0]);
+		free(s->buf[1]);
+		free(s->path);
+		free(s);
+	}
+	if (trace->map != NULL)
+		munmap(trace->map, trace->map_len);
+	free(trace->ops);
+	free(trace->blocks);
+	free(trace);
+}
+
+/*
+ * trace_rewind - Restart a streamed trace from its first request, for
+ *     trace_cursor_init. Stops the reader thread of the previous walk,
+ *     if any, and starts a new one.
+ */
+void trace_rewind(trace_cursor_t *c)
+{
+	trace_t *trace = c->trace;
+	trace_stream_t *s = trace->stream;
+	size_t i;
+
+	stream_stop(s);
+	if (fseek(s->fp, s->start, SEEK_SET) < 0)
+		trace_error(s->path, strerror(errno));
+	s->left = trace->num_ops;
+	s->index = 0;
+	s->ready[0] = s->ready[1] = 0;
+	s->cur = -1;
+	s->stop = 0;
+
+	for (i = 0; i < trace->nslots; i++)
+		trace->blocks[i].id = -1;
+	trace->nused = 0;
+
+	if (pthread_create(&s->tid, NULL, stream_thread, s) != 0)
+		trace_error(s->path, "pthread_create failed");
+	s->running = 1;
+
+	/* An empty chunk, so the first trace_next() calls trace_refill() */
+	c->op = c->op_end = s->buf[0];
+}
+
+/*
+ * trace_refill - Hand the chunk the cursor just finished back to the
+ *     reader, and move the cursor to the other one, waiting for the
+ *     reader to fill it if it hasn't yet.
+ */
+void trace_refill(trace_cursor_t *c)
+{
+	trace_stream_t *s = c->trace->stream;
+	int n;
+
+	pthread_mutex_lock(&s->lock);
+	if (s->cur >= 0)
+	{
+		s->ready[s->cur] = 0;
+		pthread_cond_broadcast(&s->cond);
+	}
+	s->cur = (s->cur + 1) & 1;
+	while (!s->ready[s->cur])
+		pthread_cond_wait(&s->cond, &s->lock);
+	n = s->len[s->cur];
+	pthread_mutex_unlock(&s->lock);
+
+	if (n == 0)
+	{
+		fprintf(stderr, "Trace %s ended after %d of %d requests\n", s->path,
+				c->trace->num_ops - c->left - 1, c->trace->num_ops);
+		exit(1);
+	}
+	c->op = s->buf[s->cur];
+	c->op_end = c->op + n;
+}
+
+/*
+ * stream_thread - Body of the reader thread of a streamed trace. Fills
+ *     the two chunk buffers in turn, each as soon as the driver hands it
+ *     back. A chunk with no requests marks the end of the file.
+ */
+static void *stream_thread(void *ptr)
+{
+	trace_stream_t *s = (trace_stream_t *)ptr;
+	traceop_t *buf;
+	int fill = 0;
+	int n, stop;
+
+	for (;;)
+	{
+		pthread_mutex_lock(&s->lock);
+		while (s->ready[fill] && !s->stop)
+			pthread_cond_wait(&s->cond, &s->lock);
+		stop = s->stop;
+		pthread_mutex_unlock(&s->lock);
+		if (stop)
+			break;
+
+		buf = s->buf[fill];
+		for (n = 0; n < TRACE_CHUNK && s->left > 0; n++, s->left--)
+			if (!(s->bin ? get_bin_op(s, &buf[n]) : get_rep_op(s->fp, &buf[n], s->path)))
+				break;
+
+		pthread_mutex_lock(&s->lock);
+		s->len[fill] = n;
+		s->ready[fill] = 1;
+		pthread_cond_broadcast(&s->cond);
+		pthread_mutex_unlock(&s->lock);
+		if (n == 0)
+			break;
+		fill = (fill + 1) & 1;
+	}
+	return NULL;
+}
+
+/*
+ * stream_stop - Stop the reader thread of a streamed trace
+ */
+static void stream_stop(trace_stream_t *s)
+{
+	if (!s->running)
+		return;
+	pthread_mutex_lock(&s->lock);
+	s->stop = 1;
+	pthread_cond_broadcast(&s->cond);
+	pthread_mutex_unlock(&s->lock);
+	pthread_join(s->tid, NULL);
+	s->running = 0;
+}
+
+/*
+ * trace_block_add - Add an entry for id, which trace_block() did not
+ *     find, to a hashed id table. The table doubles once it is half full.
+ */
+block_t *trace_block_add(trace_t *trace, int id)
+{
+	block_t *old;
+	size_t mask, i, n;
+
+	if (2 * (trace->nused + 1) > trace->nslots)
+	{
+		old = trace->blocks;
+		n = trace->nslots;
+		trace->nslots *= 2;
+		trace->nused = 0;
+		if ((trace->blocks = (block_t *)malloc(trace->nslots * sizeof(block_t))) == NULL)
+			trace_error(trace->stream->path, "malloc failed");
+		for (i = 0; i < trace->nslots; i++)
+			trace->blocks[i].id = -1;
+		for (i = 0; i < n; i++)
+			if (old[i].id != -1)
+				*trace_block_add(trace, old[i].id) = old[i];
+		free(old);
+	}
+
+	mask = trace->nslots - 1;
+	for (i = TRACE_HASH(id, trace->nslots); trace->blocks[i].id != -1; i = (i + 1) & mask)
+		;
+	trace->nused++;
+	trace->blocks[i].id = id;
+	trace->blocks[i].p = NULL;
+	trace->blocks[i].size = 0;
+	return &trace->blocks[i];
+}
+
+/*
+ * trace_block_unhash - Remove an entry from a hashed id table. Later
+ *     entries of its probe run shift back into the hole, so lookups
+ *     never need tombstones.
+ */
+void trace_block_unhash(trace_t *trace, block_t *b)
+{
+	size_t mask = trace->nslots - 1;
+	size_t i = b - trace->blocks;
+	size_t j = i;
+	size_t k;
+
+	for (;;)
+	{
+		j = (j + 1) & mask;
+		if (trace->blocks[j].id == -1)
+			break;
+		/* Entry j may fill the hole at i unless its home k lies in (i, j] */
+		k = TRACE_HASH(trace->blocks[j].id, trace->nslots);
+		if ((i <= j) ? (i < k && k <= j) : (i < k || k <= j))
+			continue;
+		trace->blocks[i] = trace->blocks[j];
+		i = j;
+	}
+	trace->blocks[i].id = -1;
+	trace->nused--;
+}
+
+/*
+ * trace_write_rep - Write the trace in the ASCII .rep format.
+ *     Returns 0 on success and -1 on a write error.
+ */
+int trace_write_rep(trace_t *trace, FILE *fp)
+{
+	trace_writer_t w;
+	trace_hdr_t hdr;
+	trace_cursor_t c;
+	traceop_t op;
+
+	memset(&hdr, 0, sizeof(hdr));
+	hdr.sugg_heapsize = trace->sugg_heapsize;
+	hdr.num_ids = trace->num_ids;
+	hdr.num_ops = trace->num_ops;
+	hdr.weight = trace->weight;
+	trace_writer_init(&w, fp, 0);
+	trace_put_header(&w, &hdr);
+	trace_cursor_init(&c, trace);
+	while (trace_next(&c, &op))
+		trace_put(&w, &op);
+	return ferror(fp) ? -1 : 0;
+}
+
+/*
+ * trace_write_bin - Write the trace in the binary format. fp must be
+ *     seekable, since the header is rewritten once the record length
+ *     is known. Returns 0 on success and -1 on a write error.
+ */
+int trace_write_bin(trace_t *trace, FILE *fp)
+{
+	trace_writer_t w;
+	trace_hdr_t hdr;
+	trace_cursor_t c;
+	traceop_t op;
+
+	memset(&hdr, 0, sizeof(hdr));
+	hdr.sugg_heapsize = trace->sugg_heapsize;
+	hdr.num_ids = trace->num_ids;
+	hdr.num_ops = trace->num_ops;
+	hdr.weight = trace->weight;
+	trace_writer_init(&w, fp, 1);
+	if (trace_put_header(&w, &hdr) < 0)
+		return -1;
+
+	trace_cursor_init(&c, trace);
+	while (trace_next(&c, &op))
+		trace_put(&w, &op);
+
+	hdr.recs_len = w.recs_len;
+	if (fseek(fp, 0, SEEK_SET) < 0 || trace_put_header(&w, &hdr) < 0)
+		return -1;
+	return ferror(fp) ? -1 : 0;
+}
+
+/*
+ * trace_writer_init - Start writing a trace to fp, which need not be
+ *     seekable. With fp NULL nothing is written, but recs_len still
+ *     adds up, so a program can find the binary header of a trace it
+ *     generates before it writes the trace.
+ */
+void trace_writer_init(trace_writer_t *w, FILE *fp, int binary)
+{
+	w->fp = fp;
+	w->binary = binary;
+	w->prev = 0;
+	w->recs_len = 0;
+}
+
+/*
+ * trace_put_header - Write the header: the four .rep header lines, or
+ *     the binary header with its magic and version filled in. Returns
+ *     0 on success and -1 on a write error.
+ */
+int trace_put_header(trace_writer_t *w, const trace_hdr_t *hdr)
+{
+	trace_hdr_t h = *hdr;
+
+	if (w->fp == NULL)
+		return 0;
+	if (!w->binary)
+	{
+		fprintf(w->fp, "%u\n%u\n%u\n%u\n", h.sugg_heapsize, h.num_ids,
+				h.num_ops, h.weight);
+		return ferror(w->fp) ? -1 : 0;
+	}
+	memcpy(h.magic, TRACE_MAGIC, sizeof(h.magic));
+	h.version = TRACE_VERSION;
+	return fwrite(&h, sizeof(h), 1, w->fp) == 1 ? 0 : -1;
+}
+
+/*
+ * trace_put - Write one request. Write errors show up in ferror(fp).
+ *     Returns the bytes of a binary record, or 0 for a .rep line.
+ */
+int trace_put(trace_writer_t *w, const traceop_t *op)
+{
+	int64_t delta;
+	uint64_t zz;
+	int n;
+
+	if (!w->binary)
+	{
+		if (w->fp == NULL)
+			return 0;
+		if (op->type == FREE)
+			fprintf(w->fp, "f %d\n", op->index);
+		else
+			fprintf(w->fp, "%c %d %zu\n", op->type == ALLOC ? 'a' : 'r',
+					op->index, op->size);
+		return 0;
+	}
+
+	delta = (int64_t)op->index - w->prev;
+	w->prev = op->index;
+	zz = ((uint64_t)delta << 1) ^ (uint64_t)(delta >> 63);
+	n = put_varint((zz << 2) | op->type, w->fp);
+	if (op->type != FREE)
+		n += put_varint(op->size, w->fp);
+	w->recs_len += n;
+	return n;
+}
+
+/*
+ * put_varint - Write v as an LEB128 varint (unless fp is NULL) and
+ *     return its length
+ */
+static int put_varint(uint64_t v, FILE *fp)
+{
+	int n = 1;
+
+	while (v >= 0x80)
+	{
+		if (fp != NULL)
+			putc((v & 0x7f) | 0x80, fp);
+		v >>= 7;
+		n++;
+	}
+	if (fp != NULL)
+		putc(v, fp);
+	return n;
+}
+
+/*
+ * trace_corrupt - Report a binary record that trace_next() can't decode
+ */
+void trace_corrupt(const trace_cursor_t *c)
+{
+	fprintf(stderr, "Corrupt binary trace at request %d (byte %zu)\n",
+			c->trace->num_ops - c->left - 1,
+			(size_t)(c->p - c->trace->recs));
+	exit(1);
+}
+
+/*
+ * trace_error - Report a trace file that can't be read
+ */
+static void trace_error(const char *path, const char *msg)
+{
+	fprintf(stderr, "Could not read trace %s: %s\n", path, msg);
+	exit(1);
+}
@@ -0,0 +1,227 @@
+/*
+ * trace.h - Trace files for the malloc lab driver and its tools
+ *
+ * A trace is either an ASCII .rep file, which is parsed into an array
+ * of requests, or a binary trace, which is mapped read-only and decoded
+ * one request at a time while it is replayed. Either kind can also be
+ * streamed from disk in fixed-size chunks, for recordings too long to
+ * hold in memory. All three are walked with a trace_cursor_t. See
+ * traces/README for the two file formats.
+ */
+#ifndef __TRACE_H_
+#define __TRACE_H_
+
+#include <stdio.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/* Requests per chunk of a streamed trace (two chunks are buffered) */
+#define TRACE_CHUNK 16384
+
+/* Initial number of slots in the id table of a streamed trace */
+#define TRACE_HASH_MIN 1024
+
+/* Home slot of an id in a hashed id table of nslots slots */
+#define TRACE_HASH(id, nslots) ((size_t)((uint32_t)(id) * 0x9E3779B1u) & ((nslots) - 1))
+
+/* Binary trace header: magic and format version */
+#define TRACE_MAGIC "MLTR"
+#define TRACE_VERSION 1
+
+/* Characterizes a single trace operation (allocator request) */
+typedef struct
+{
+	enum
+	{
+		ALLOC = 0,
+		FREE = 1,
+		REALLOC = 2
+	} type;		 /* type of request (also its binary record tag) */
+	int index;	 /* index for free() to use later */
+	size_t size; /* byte size of alloc/realloc request */
+} traceop_t;
+
+/* The fixed header at the start of a binary trace (host byte order) */
+typedef struct
+{
+	char magic[4];			/* TRACE_MAGIC */
+	uint32_t version;		/* TRACE_VERSION */
+	uint32_t sugg_heapsize; /* suggested heap size (unused) */
+	uint32_t num_ids;		/* number of alloc/realloc ids */
+	uint32_t num_ops;		/* number of requests */
+	uint32_t weight;		/* weight for this trace (unused) */
+	uint64_t recs_len;		/* bytes of packed records after the header */
+} trace_hdr_t;
+
+/* The driver's record of the block that one id currently names */
+typedef struct
+{
+	int id;		 /* the id (hashed id tables only; -1 if the slot is empty) */
+	char *p;	 /* pointer returned by malloc/realloc... */
+	size_t size; /* ... and its payload size */
+} block_t;
+
+/* Writes a trace one request at a time (see trace_put) */
+typedef struct
+{
+	FILE *fp;		   /* where to, or NULL to only count record bytes */
+	int binary;		   /* binary records, or .rep lines */
+	int64_t prev;	   /* index of the previous binary record */
+	uint64_t recs_len; /* binary record bytes put so far */
+} trace_writer_t;
+
+typedef struct trace_stream trace_stream_t;
+
+/* Holds the information for one trace file*/
+typedef struct
+{
+	int sugg_heapsize;			/* suggested heap size (unused) */
+	int num_ids;				/* number of alloc/realloc ids */
+	int num_ops;				/* number of distinct requests */
+	int weight;					/* weight for this trace (unused) */
+	traceop_t *ops;				/* array of requests (.rep traces only) */
+	const unsigned char *recs;	/* packed requests (binary traces only) */
+	size_t recs_len;			/* ... and their length in bytes */
+	void *map;					/* mapping of a binary trace file */
+	size_t map_len;				/* ... and its length */
+	trace_stream_t *stream;		/* reader of a streamed trace */
+	block_t *blocks;			/* id table, indexed by id or hashed (streams) */
+	size_t nslots;				/* slots in a hashed id table, 0 if indexed */
+	size_t nused;				/* ... and how many of them are in use */
+} trace_t;
+
+/* Walks the requests of one trace in order */
+typedef struct
+{
+	trace_t *trace;
+	int left;				  /* requests not returned yet */
+	const traceop_t *op;	  /* next request of a parsed or streamed trace */
+	const traceop_t *op_end;  /* end of the parsed requests or stream chunk */
+	const unsigned char *p;	  /* next record of a binary trace */
+	const unsigned char *end; /* end of the binary records */
+	long index;				  /* index of the previous binary record */
+} trace_cursor_t;
+
+trace_t *trace_read(const char *path);
+trace_t *trace_open_stream(const char *path);
+void trace_free(trace_t *trace);
+int trace_write_rep(trace_t *trace, FILE *fp);
+int trace_write_bin(trace_t *trace, FILE *fp);
+void trace_writer_init(trace_writer_t *w, FILE *fp, int binary);
+int trace_put_header(trace_writer_t *w, const trace_hdr_t *hdr);
+int trace_put(trace_writer_t *w, const traceop_t *op);
+void trace_rewind(trace_cursor_t *c);
+void trace_refill(trace_cursor_t *c);
+void trace_corrupt(const trace_cursor_t *c) __attribute__((noreturn));
+block_t *trace_block_add(trace_t *trace, int id);
+void trace_block_unhash(trace_t *trace, block_t *b);
+
+/*
+ * trace_cursor_init - Start a walk at the first request of the trace.
+ *     A streamed trace has only one walk at a time: starting a new one
+ *     rewinds the file and empties the id table.
+ */
+static inline void trace_cursor_init(trace_cursor_t *c, trace_t *trace)
+{
+	c->trace = trace;
+	c->left = trace->num_ops;
+	c->op = trace->ops;
+	c->op_end = (trace->ops != NULL) ? trace->ops + trace->num_ops : NULL;
+	c->p = trace->recs;
+	c->end = trace->recs + trace->recs_len;
+	c->index = 0;
+	if (trace->stream != NULL)
+		trace_rewind(c);
+}
+
+/*
+ * trace_varint - Decode one LEB128 varint and step past it. The loader
+ *     checks that the last record byte ends a varint, so this never
+ *     runs off the end of the mapping.
+ */
+static inline uint64_t trace_varint(const unsigned char **pp)
+{
+	const unsigned char *p = *pp;
+	uint64_t v = 0;
+	int shift = 0;
+
+	while ((*p & 0x80) && shift < 63)
+	{
+		v |= (uint64_t)(*p++ & 0x7f) << shift;
+		shift += 7;
+	}
+	v |= (uint64_t)*p++ << shift;
+	*pp = p;
+	return v;
+}
+
+/*
+ * trace_next - Store the next request in *op. Returns 0 once the walk
+ *     has returned every request. A binary record is a varint holding
+ *     the type in bits 0-1 and the zigzag-coded difference from the
+ *     previous record's index above them, followed by a varint size
+ *     for alloc and realloc requests.
+ */
+static inline int trace_next(trace_cursor_t *c, traceop_t *op)
+{
+	uint64_t v, zz;
+
+	if (c->left == 0)
+		return 0;
+	c->left--;
+	if (c->op != NULL)
+	{
+		if (c->op == c->op_end)
+			trace_refill(c);
+		*op = *c->op++;
+		return 1;
+	}
+
+	if (c->p >= c->end)
+		trace_corrupt(c);
+	v = trace_varint(&c->p);
+	zz = v >> 2;
+	c->index += (long)(zz >> 1) ^ -(long)(zz & 1);
+	if ((v & 3) > REALLOC || c->index < 0 || c->index >= c->trace->num_ids)
+		trace_corrupt(c);
+	op->type = v & 3;
+	op->index = c->index;
+	op->size = 0;
+	if (op->type != FREE)
+	{
+		if (c->p >= c->end)
+			trace_corrupt(c);
+		op->size = trace_varint(&c->p);
+	}
+	return 1;
+}
+
+/*
+ * trace_block - Return the id table entry of id. A hashed table adds
+ *     an empty entry for an id it has not seen. Hashed tables use
+ *     linear probing and are never more than half full.
+ */
+static inline block_t *trace_block(trace_t *trace, int id)
+{
+	size_t mask = trace->nslots - 1;
+	size_t i;
+
+	if (trace->nslots == 0)
+		return &trace->blocks[id];
+	for (i = TRACE_HASH(id, trace->nslots); trace->blocks[i].id != -1; i = (i + 1) & mask)
+		if (trace->blocks[i].id == id)
+			return &trace->blocks[i];
+	return trace_block_add(trace, id);
+}
+
+/*
+ * trace_block_drop - Forget the entry of an id that was just freed, so
+ *     a hashed table only holds live blocks. b is invalid afterwards.
+ */
+static inline void trace_block_drop(trace_t *trace, block_t *b)
+{
+	if (trace->nslots != 0)
+		trace_block_unhash(trace, b);
+}
+
+#endif /* __TRACE_H_ */
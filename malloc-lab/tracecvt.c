@@ -0,0 +1,66 @@
+/*
+ * tracecvt.c - Convert malloc lab traces between the ASCII .rep format
+ *     and the binary format that mdriver maps without parsing.
+ *
+ * usage: tracecvt [-r] <infile> <outfile>
+ *
+ * The input format is detected from the file. The output is binary,
+ * or ASCII with -r.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "trace.h"
+
+static void usage(void)
+{
+	fprintf(stderr, "Usage: tracecvt [-hr] <infile> <outfile>\n");
+	fprintf(stderr, "Options\n");
+	fprintf(stderr, "\t-h         Print this message.\n");
+	fprintf(stderr, "\t-r         Write an ASCII .rep trace (default: binary).\n");
+}
+
+int main(int argc, char **argv)
+{
+	int c;
+	int to_rep = 0;
+	trace_t *trace;
+	FILE *fp;
+
+	while ((c = getopt(argc, argv, "hr")) != EOF)
+	{
+		switch (c)
+		{
+		case 'r':
+			to_rep = 1;
+			break;
+		case 'h':
+			usage();
+			exit(0);
+		default:
+			usage();
+			exit(1);
+		}
+	}
+	if (argc - optind != 2)
+	{
+		usage();
+		exit(1);
+	}
+
+	trace = trace_read(argv[optind]);
+	if ((fp = fopen(argv[optind + 1], "w")) == NULL)
+	{
+		perror(argv[optind + 1]);
+		exit(1);
+	}
+	if ((to_rep ? trace_write_rep(trace, fp) : trace_write_bin(trace, fp)) < 0 ||
+		fclose(fp) != 0)
+	{
+		perror(argv[optind + 1]);
+		exit(1);
+	}
+	trace_free(trace);
+	return 0;
+}
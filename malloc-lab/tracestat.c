@@ -0,0 +1,398 @@
+/*
+ * tracestat.c - Profile the requests of a malloc lab trace
+ *
+ * usage: tracestat [-hS] [-n <points>] [-o <prefix>] <trace>
+ *
+ * Prints a summary of the trace, including its theoretical peak: the
+ * most payload bytes live at once, which no allocator can go below and
+ * which the driver divides by the heap size to get utilization. With
+ * -o it also writes four CSV files for plotting:
+ *
+ *   <prefix>-sizes.csv      requests per size class of the linked
+ *                           package (mm_size_class), or per power of
+ *                           two if it has none; the first three columns
+ *                           also make a gentrace -s hist: file
+ *   <prefix>-lifetimes.csv  lifetimes of the blocks, in requests from
+ *                           malloc to free, by the class of the size
+ *                           they were freed at
+ *   <prefix>-live.csv       live payload bytes and blocks, sampled at
+ *                           <points> evenly spaced requests, with the
+ *                           highest byte count since the previous sample
+ *   <prefix>-realloc.csv    reallocs by the ratio of new to old size,
+ *                           in quarter-octave buckets
+ *
+ * Traces are read as the driver reads them, so a binary trace is
+ * mapped, and -S streams either kind from disk.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <math.h>
+#include <unistd.h>
+
+#include "mm.h"
+#include "config.h"
+#include "trace.h"
+#include "latency.h"
+
+#define POINTS 1000		/* default samples of the live curve (-n) */
+#define MAX_CLASSES 64	/* size classes kept apart; larger ones share the last */
+#define RATIO_STEPS 4	/* realloc ratio buckets per doubling */
+#define RATIO_OCTAVES 4 /* ratios beyond 2^-4 and 2^4 share the end buckets */
+#define RATIO_BUCKETS (2 * RATIO_STEPS * RATIO_OCTAVES + 2)
+
+/* Rounds a size up to ALIGNMENT, the least any package can give */
+#define ALIGN(size) (((size) + (ALIGNMENT - 1)) & ~(size_t)(ALIGNMENT - 1))
+
+/* What the requests of one size class did */
+typedef struct
+{
+	char name[32];
+	uint64_t mallocs, reallocs; /* requests of a size in this class */
+	double bytes;				/* ... and the bytes they asked for */
+	size_t min, max;			/* smallest and largest of them */
+	lathist_t life;				/* lifetimes of blocks freed in it */
+} class_t;
+
+static class_t classes[MAX_CLASSES];
+static uint64_t ratios[RATIO_BUCKETS];
+
+static int size_class(size_t size);
+static void add_request(int cls, size_t size);
+static void add_life(lathist_t *h, uint64_t v);
+static int ratio_bucket(double ratio);
+static double ratio_bound(int bucket);
+static FILE *open_csv(const char *prefix, const char *name);
+static void write_sizes(const char *prefix);
+static void write_lifetimes(const char *prefix);
+static void write_realloc(const char *prefix, uint64_t reallocs);
+static void usage(void);
+
+int main(int argc, char **argv)
+{
+	int c, cls, stream = 0;
+	long points = POINTS, interval;
+	const char *prefix = NULL;
+	trace_t *trace;
+	trace_cursor_t cur;
+	traceop_t op;
+	block_t *b;
+	long i, peak_op = 0;
+	uint64_t mallocs = 0, reallocs = 0, frees = 0, unfreed = 0;
+	double bytes = 0;
+	size_t live = 0, live_aligned = 0, peak = 0, peak_aligned = 0, window = 0;
+	long blocks = 0, peak_blocks = 0;
+	FILE *live_fp = NULL;
+
+	while ((c = getopt(argc, argv, "hSn:o:")) != EOF)
+	{
+		switch (c)
+		{
+		case 'S':
+			stream = 1;
+			break;
+		case 'n':
+			points = atol(optarg);
+			if (points < 1)
+			{
+				fprintf(stderr, "-n expects a number of points\n");
+				exit(1);
+			}
+			break;
+		case 'o':
+			prefix = optarg;
+			break;
+		case 'h':
+			usage();
+			exit(0);
+		default:
+			usage();
+			exit(1);
+		}
+	}
+	if (argc - optind != 1)
+	{
+		usage();
+		exit(1);
+	}
+
+	trace = stream ? trace_open_stream(argv[optind]) : trace_read(argv[optind]);
+	interval = (trace->num_ops + points - 1) / points;
+	if (interval < 1)
+		interval = 1;
+	if (prefix)
+	{
+		live_fp = open_csv(prefix, "live");
+		fprintf(live_fp, "op,live_bytes,live_blocks,max_bytes\n");
+	}
+
+	/*
+	 * Replay the trace. A block's id table entry holds its size and,
+	 * in place of a pointer, the number of the request that made it.
+	 */
+	trace_cursor_init(&cur, trace);
+	for (i = 0; trace_next(&cur, &op); i++)
+	{
+		b = trace_block(trace, op.index);
+		switch (op.type)
+		{
+		case ALLOC:
+			cls = size_class(op.size);
+			classes[cls].mallocs++;
+			add_request(cls, op.size);
+			mallocs++;
+			bytes += op.size;
+			b->p = (char *)(uintptr_t)i;
+			b->size = op.size;
+			live += op.size;
+			live_aligned += ALIGN(op.size);
+			blocks++;
+			break;
+		case REALLOC:
+			cls = size_class(op.size);
+			classes[cls].reallocs++;
+			add_request(cls, op.size);
+			reallocs++;
+			bytes += op.size;
+			ratios[ratio_bucket((double)op.size / (b->size ? b->size : 1))]++;
+			live += op.size - b->size;
+			live_aligned += ALIGN(op.size) - ALIGN(b->size);
+			b->size = op.size;
+			break;
+		case FREE:
+			add_life(&classes[size_class(b->size)].life, i - (uintptr_t)b->p);
+			frees++;
+			live -= b->size;
+			live_aligned -= ALIGN(b->size);
+			blocks--;
+			trace_block_drop(trace, b);
+			break;
+		}
+
+		if (live > peak)
+		{
+			peak = live;
+			peak_op = i;
+			peak_blocks = blocks;
+		}
+		if (live_aligned > peak_aligned)
+			peak_aligned = live_aligned;
+		if (live > window)
+			window = live;
+		if (live_fp && ((i + 1) % interval == 0 || i + 1 == trace->num_ops))
+		{
+			fprintf(live_fp, "%ld,%zu,%ld,%zu\n", i + 1, live, blocks, window);
+			window = live;
+		}
+	}
+
+	/* Blocks the trace never frees (none in a balanced trace) */
+	unfreed = mallocs - frees;
+
+	printf("Trace %s\n", argv[optind]);
+	printf("requests          %d (%lu mallocs, %lu reallocs, %lu frees) on %d ids\n",
+		   trace->num_ops, mallocs, reallocs, frees, trace->num_ids);
+	printf("bytes requested   %.0f (%.1f per request)\n",
+		   bytes, mallocs + reallocs ? bytes / (mallocs + reallocs) : 0.0);
+	printf("theoretical peak  %zu bytes in %ld blocks, at request %ld (.rep line %ld)\n",
+		   peak, peak_blocks, peak_op, peak_op + 5);
+	printf("... aligned       %zu bytes with each size rounded up to %d\n",
+		   peak_aligned, ALIGNMENT);
+	printf("unfreed blocks    %lu\n", unfreed);
+
+	if (prefix)
+	{
+		if (fclose(live_fp) != 0)
+		{
+			perror("live CSV");
+			exit(1);
+		}
+		write_sizes(prefix);
+		write_lifetimes(prefix);
+		write_realloc(prefix, reallocs);
+	}
+	trace_free(trace);
+	exit(0);
+}
+
+/*
+ * size_class - The size class of a request, as the package's
+ *     mm_size_class names it, or the power of two at or above the size
+ */
+static int size_class(size_t size)
+{
+	char name[32];
+	int cls = 0;
+
+	if (mm_size_class)
+		cls = mm_size_class(size, name, sizeof(name));
+	else
+	{
+		while (cls < 63 && ((size_t)1 << cls) < size)
+			cls++;
+		snprintf(name, sizeof(name), "pow2-%zu", (size_t)1 << cls);
+	}
+	if (cls >= MAX_CLASSES)
+	{
+		cls = MAX_CLASSES - 1;
+		snprintf(name, sizeof(name), "larger");
+	}
+	if (classes[cls].name[0] == '\0')
+		strcpy(classes[cls].name, name);
+	return cls;
+}
+
+/*
+ * add_request - Count the bytes and extent of a request in its class
+ */
+static void add_request(int cls, size_t size)
+{
+	class_t *c = &classes[cls];
+
+	if (c->bytes == 0 || size < c->min)
+		c->min = size;
+	if (size > c->max)
+		c->max = size;
+	c->bytes += size;
+}
+
+/*
+ * add_life - Count one lifetime
+ */
+static void add_life(lathist_t *h, uint64_t v)
+{
+	h->count++;
+	h->sum += v;
+	h->buckets[lat_bucket(v)]++;
+	if (v > h->max)
+		h->max = v;
+}
+
+/*
+ * ratio_bucket - The bucket of a realloc that multiplies the size by
+ *     ratio: bucket k holds ratios in [2^(k/RATIO_STEPS), 2^((k+1)/..)),
+ *     offset so that the first bucket holds everything below 2^-4
+ */
+static int ratio_bucket(double ratio)
+{
+	double k = floor(log2(ratio) * RATIO_STEPS);
+
+	if (k < -RATIO_STEPS * RATIO_OCTAVES)
+		return 0;
+	if (k >= RATIO_STEPS * RATIO_OCTAVES)
+		return RATIO_BUCKETS - 1;
+	return (int)k + RATIO_STEPS * RATIO_OCTAVES + 1;
+}
+
+/*
+ * ratio_bound - The smallest ratio in a bucket (0 for the first)
+ */
+static double ratio_bound(int bucket)
+{
+	if (bucket == 0)
+		return 0;
+	return pow(2, (double)(bucket - 1 - RATIO_STEPS * RATIO_OCTAVES) / RATIO_STEPS);
+}
+
+static FILE *open_csv(const char *prefix, const char *name)
+{
+	char path[1024];
+	FILE *fp;
+
+	snprintf(path, sizeof(path), "%s-%s.csv", prefix, name);
+	if ((fp = fopen(path, "w")) == NULL)
+	{
+		perror(path);
+		exit(1);
+	}
+	return fp;
+}
+
+/*
+ * write_sizes - Requests per size class, smallest class first
+ */
+static void write_sizes(const char *prefix)
+{
+	FILE *fp = open_csv(prefix, "sizes");
+	int i;
+
+	fprintf(fp, "min_size,max_size,requests,mallocs,reallocs,bytes,class\n");
+	for (i = 0; i < MAX_CLASSES; i++)
+		if (classes[i].mallocs + classes[i].reallocs > 0)
+			fprintf(fp, "%zu,%zu,%lu,%lu,%lu,%.0f,%s\n",
+					classes[i].min, classes[i].max,
+					classes[i].mallocs + classes[i].reallocs,
+					classes[i].mallocs, classes[i].reallocs,
+					classes[i].bytes, classes[i].name);
+	if (fclose(fp) != 0)
+	{
+		perror("sizes CSV");
+		exit(1);
+	}
+}
+
+/*
+ * write_lifetimes - Lifetime percentiles per size class. Like the -L
+ *     latencies, they come from log-linear histograms and are accurate
+ *     to about 1/LAT_SUB of their value.
+ */
+static void write_lifetimes(const char *prefix)
+{
+	FILE *fp = open_csv(prefix, "lifetimes");
+	lathist_t *h;
+	int i;
+
+	fprintf(fp, "class,blocks,mean,p50,p90,p99,max\n");
+	for (i = 0; i < MAX_CLASSES; i++)
+	{
+		h = &classes[i].life;
+		if (h->count == 0)
+			continue;
+		fprintf(fp, "%s,%lu,%.1f,%lu,%lu,%lu,%lu\n", classes[i].name, h->count,
+				h->sum / h->count, lat_percentile(h, 50), lat_percentile(h, 90),
+				lat_percentile(h, 99), h->max);
+	}
+	if (fclose(fp) != 0)
+	{
+		perror("lifetimes CSV");
+		exit(1);
+	}
+}
+
+/*
+ * write_realloc - Reallocs by growth ratio, with the running total
+ */
+static void write_realloc(const char *prefix, uint64_t reallocs)
+{
+	FILE *fp = open_csv(prefix, "realloc");
+	uint64_t seen = 0;
+	int i;
+
+	fprintf(fp, "min_ratio,max_ratio,reallocs,pct,cum_pct\n");
+	for (i = 0; i < RATIO_BUCKETS && reallocs > 0; i++)
+	{
+		seen += ratios[i];
+		if (i == RATIO_BUCKETS - 1)
+			fprintf(fp, "%.4f,inf,", ratio_bound(i));
+		else
+			fprintf(fp, "%.4f,%.4f,", ratio_bound(i), ratio_bound(i + 1));
+		fprintf(fp, "%lu,%.2f,%.2f\n", ratios[i], 100.0 * ratios[i] / reallocs,
+				100.0 * seen / reallocs);
+	}
+	if (fclose(fp) != 0)
+	{
+		perror("realloc CSV");
+		exit(1);
+	}
+}
+
+static void usage(void)
+{
+	fprintf(stderr, "Usage: tracestat [-hS] [-n <points>] [-o <prefix>] <trace>\n");
+	fprintf(stderr, "Options\n");
+	fprintf(stderr, "\t-h           Print this message.\n");
+	fprintf(stderr, "\t-n <points>  Samples of the live-bytes curve (default %d).\n", POINTS);
+	fprintf(stderr, "\t-o <prefix>  Write <prefix>-{sizes,lifetimes,live,realloc}.csv.\n");
+	fprintf(stderr, "\t-S           Stream the trace from disk instead of loading it.\n");
+}